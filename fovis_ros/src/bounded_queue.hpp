@@ -0,0 +1,117 @@
+#ifndef BOUNDED_QUEUE_H_
+#define BOUNDED_QUEUE_H_
+
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace fovis_ros
+{
+
+/**
+ * Thread safe FIFO queue with a fixed capacity for handing data from
+ * one thread to another. When the queue is full, pushing a new element
+ * drops the oldest one. A queue with capacity 1 therefore acts as a
+ * "latest wins" slot. The elements are kept in a ring buffer that is
+ * allocated once on construction.
+ */
+template <typename T>
+class BoundedQueue
+{
+
+public:
+
+  BoundedQueue(size_t capacity) :
+    values_(capacity),
+    head_(0),
+    size_(0),
+    shutdown_(false)
+  {
+  }
+
+  /**
+   * Appends a copy of value to the queue.
+   * \return true if the oldest element was dropped to make room
+   */
+  bool push(const T& value)
+  {
+    bool dropped = false;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (size_ == values_.size())
+      {
+        values_[head_] = value;
+        head_ = (head_ + 1) % values_.size();
+        dropped = true;
+      }
+      else
+      {
+        values_[(head_ + size_) % values_.size()] = value;
+        ++size_;
+      }
+    }
+    condition_.notify_one();
+    return dropped;
+  }
+
+  /**
+   * Blocks until an element is available and removes it from the queue.
+   * \return false if the queue has been shut down
+   */
+  bool pop(T& value)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (size_ == 0 && !shutdown_)
+    {
+      condition_.wait(lock);
+    }
+    if (shutdown_) return false;
+    value = values_[head_];
+    // release what the element holds, its slot may not be reused soon
+    values_[head_] = T();
+    head_ = (head_ + 1) % values_.size();
+    --size_;
+    return true;
+  }
+
+  /**
+   * Removes the oldest element if there is one, never blocks.
+   * \return false if the queue is empty or has been shut down
+   */
+  bool tryPop(T& value)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (size_ == 0 || shutdown_) return false;
+    value = values_[head_];
+    values_[head_] = T();
+    head_ = (head_ + 1) % values_.size();
+    --size_;
+    return true;
+  }
+
+  /**
+   * Wakes up all waiting consumers, subsequent calls to pop() fail.
+   */
+  void shutdown()
+  {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      shutdown_ = true;
+    }
+    condition_.notify_all();
+  }
+
+private:
+
+  std::vector<T> values_;
+  size_t head_;
+  size_t size_;
+  bool shutdown_;
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef CALIBRATION_CACHE_H_
+#define CALIBRATION_CACHE_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <ros/ros.h>
+#include <ros/serialization.h>
+#include <sensor_msgs/CameraInfo.h>
+
+namespace fovis_ros
+{
+
+/**
+ * Stores the camera infos an odometer was initialized with, so that the
+ * next start can build the odometer before the first message arrives.
+ * The file holds the number of messages followed by the size and the
+ * ROS serialization of each message.
+ */
+namespace calibration_cache
+{
+
+typedef std::vector<sensor_msgs::CameraInfoConstPtr> CameraInfos;
+
+/**
+ * Compares everything of the camera infos that goes into the odometer,
+ * the header stamp and sequence number are ignored.
+ */
+inline bool isSameCalibration(const sensor_msgs::CameraInfo& a,
+    const sensor_msgs::CameraInfo& b)
+{
+  return a.header.frame_id == b.header.frame_id &&
+    a.height == b.height && a.width == b.width &&
+    a.distortion_model == b.distortion_model &&
+    a.D == b.D && a.K == b.K && a.R == b.R && a.P == b.P &&
+    a.binning_x == b.binning_x && a.binning_y == b.binning_y &&
+    a.roi.x_offset == b.roi.x_offset && a.roi.y_offset == b.roi.y_offset &&
+    a.roi.width == b.roi.width && a.roi.height == b.roi.height &&
+    a.roi.do_rectify == b.roi.do_rectify;
+}
+
+inline bool isSameCalibration(const CameraInfos& a, const CameraInfos& b)
+{
+  if (a.size() != b.size()) return false;
+  for (size_t i = 0; i < a.size(); ++i)
+  {
+    if (!a[i] || !b[i] || !isSameCalibration(*a[i], *b[i])) return false;
+  }
+  return true;
+}
+
+/**
+ * \return false if the file does not exist or cannot be read
+ */
+inline bool load(const std::string& filename, CameraInfos& infos)
+{
+  FILE* file = std::fopen(filename.c_str(), "rb");
+  if (!file) return false;
+  infos.clear();
+  uint32_t num_infos = 0;
+  bool ok = std::fread(&num_infos, sizeof(num_infos), 1, file) == 1;
+  std::vector<uint8_t> buffer;
+  for (uint32_t i = 0; ok && i < num_infos; ++i)
+  {
+    uint32_t size = 0;
+    ok = std::fread(&size, sizeof(size), 1, file) == 1 && size > 0;
+    if (!ok) break;
+    buffer.resize(size);
+    ok = std::fread(&buffer[0], 1, size, file) == size;
+    if (!ok) break;
+    sensor_msgs::CameraInfoPtr info(new sensor_msgs::CameraInfo);
+    try
+    {
+      ros::serialization::IStream stream(&buffer[0], size);
+      ros::serialization::deserialize(stream, *info);
+    }
+    catch (const ros::Exception&)
+    {
+      ok = false;
+      break;
+    }
+    infos.push_back(info);
+  }
+  std::fclose(file);
+  if (!ok) infos.clear();
+  return ok;
+}
+
+/**
+ * Replaces the file, the new content is written to a temporary file
+ * first so an interrupted write leaves the old calibration intact.
+ * \return false if the file cannot be written
+ */
+inline bool save(const std::string& filename, const CameraInfos& infos)
+{
+  std::string tmp_filename = filename + ".tmp";
+  FILE* file = std::fopen(tmp_filename.c_str(), "wb");
+  if (!file) return false;
+  uint32_t num_infos = infos.size();
+  bool ok = std::fwrite(&num_infos, sizeof(num_infos), 1, file) == 1;
+  std::vector<uint8_t> buffer;
+  for (size_t i = 0; ok && i < infos.size(); ++i)
+  {
+    uint32_t size = ros::serialization::serializationLength(*infos[i]);
+    buffer.resize(size);
+    ros::serialization::OStream stream(&buffer[0], size);
+    ros::serialization::serialize(stream, *infos[i]);
+    ok = std::fwrite(&size, sizeof(size), 1, file) == 1 &&
+      std::fwrite(&buffer[0], 1, size, file) == size;
+  }
+  ok = std::fclose(file) == 0 && ok;
+  if (ok) ok = std::rename(tmp_filename.c_str(), filename.c_str()) == 0;
+  if (!ok) std::remove(tmp_filename.c_str());
+  return ok;
+}
+
+} // end of namespace
+
+} // end of namespace
+
+#endif
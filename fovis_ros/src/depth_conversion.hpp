@@ -0,0 +1,133 @@
+#ifndef DEPTH_CONVERSION_H_
+#define DEPTH_CONVERSION_H_
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define FOVIS_ROS_DEPTH_CONVERSION_SSE2
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FOVIS_ROS_DEPTH_CONVERSION_NEON
+#endif
+
+namespace fovis_ros
+{
+
+/**
+ * Converts 16 bit depth images (millimeters as published by OpenNI
+ * drivers, encoding 16UC1) to metric float depth as fovis expects it.
+ * The conversion is done with a lookup table that also maps the raw
+ * value 0 (no measurement) to NaN, so invalid pixels are handled in
+ * the same pass. On SSE2 and NEON capable targets whole rows are
+ * converted with vector instructions instead, which compute the same
+ * values as the table.
+ */
+class DepthConverter
+{
+
+public:
+
+  /**
+   * \param scale Factor to convert raw values to meters
+   */
+  DepthConverter(float scale = 0.001f) :
+    scale_(scale),
+    table_(1 << 16)
+  {
+    table_[0] = std::numeric_limits<float>::quiet_NaN();
+    for (size_t i = 1; i < table_.size(); ++i)
+    {
+      table_[i] = static_cast<float>(i) * scale;
+    }
+  }
+
+  float operator()(uint16_t raw_depth) const
+  {
+    return table_[raw_depth];
+  }
+
+  /**
+   * Converts the CV_16UC1 depth image into output, which must hold
+   * cols * rows floats. Row padding of the image is removed.
+   */
+  void convert(const cv::Mat& depth_image, float* output) const
+  {
+    convertRows(depth_image, output, 0, depth_image.rows);
+  }
+
+  /**
+   * Converts only the rows [begin_row, end_row), to split the conversion
+   * into bands that run concurrently.
+   */
+  void convertRows(const cv::Mat& depth_image, float* output,
+      int begin_row, int end_row) const
+  {
+    for (int row = begin_row; row < end_row; ++row)
+    {
+      const uint16_t* raw_row = depth_image.ptr<uint16_t>(row);
+      float* output_row = output + row * depth_image.cols;
+      convertRow(raw_row, output_row, depth_image.cols);
+    }
+  }
+
+private:
+
+  void convertRow(const uint16_t* raw_row, float* output_row, size_t width) const
+  {
+    size_t col = 0;
+#if defined(FOVIS_ROS_DEPTH_CONVERSION_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 zero_ps = _mm_setzero_ps();
+    const __m128 scale = _mm_set1_ps(scale_);
+    const __m128 nan = _mm_set1_ps(table_[0]);
+    for (; col + 8 <= width; col += 8)
+    {
+      __m128i raw = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(raw_row + col));
+      __m128 low = _mm_cvtepi32_ps(_mm_unpacklo_epi16(raw, zero));
+      __m128 high = _mm_cvtepi32_ps(_mm_unpackhi_epi16(raw, zero));
+      __m128 low_invalid = _mm_cmpeq_ps(low, zero_ps);
+      __m128 high_invalid = _mm_cmpeq_ps(high, zero_ps);
+      low = _mm_mul_ps(low, scale);
+      high = _mm_mul_ps(high, scale);
+      low = _mm_or_ps(_mm_andnot_ps(low_invalid, low),
+                      _mm_and_ps(low_invalid, nan));
+      high = _mm_or_ps(_mm_andnot_ps(high_invalid, high),
+                       _mm_and_ps(high_invalid, nan));
+      _mm_storeu_ps(output_row + col, low);
+      _mm_storeu_ps(output_row + col + 4, high);
+    }
+#elif defined(FOVIS_ROS_DEPTH_CONVERSION_NEON)
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t nan = vdupq_n_f32(table_[0]);
+    for (; col + 8 <= width; col += 8)
+    {
+      uint16x8_t raw = vld1q_u16(raw_row + col);
+      float32x4_t low = vcvtq_f32_u32(vmovl_u16(vget_low_u16(raw)));
+      float32x4_t high = vcvtq_f32_u32(vmovl_u16(vget_high_u16(raw)));
+      uint32x4_t low_invalid = vceqq_f32(low, zero);
+      uint32x4_t high_invalid = vceqq_f32(high, zero);
+      low = vmulq_n_f32(low, scale_);
+      high = vmulq_n_f32(high, scale_);
+      vst1q_f32(output_row + col, vbslq_f32(low_invalid, nan, low));
+      vst1q_f32(output_row + col + 4, vbslq_f32(high_invalid, nan, high));
+    }
+#endif
+    for (; col < width; ++col)
+    {
+      output_row[col] = table_[raw_row[col]];
+    }
+  }
+
+  float scale_;
+  std::vector<float> table_;
+};
+
+} // end of namespace
+
+#endif
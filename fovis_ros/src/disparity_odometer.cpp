@@ -0,0 +1,26 @@
+#include <ros/ros.h>
+
+#include "disparity_odometer.hpp"
+
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "disparity_odometer");
+  if (ros::names::remap("stereo") == "stereo") {
+    ROS_WARN("'stereo' has not been remapped! Example command-line usage:\n"
+             "\t$ rosrun fovis_ros disparity_odometer stereo:=narrow_stereo image:=image_rect");
+  }
+  if (ros::names::remap("image").find("rect") == std::string::npos) {
+    ROS_WARN("disparity_odometer needs rectified input images. The used image "
+             "topic is '%s'. Are you sure the images are rectified?",
+             ros::names::remap("image").c_str());
+  }
+
+  std::string transport = argc > 1 ? argv[1] : "raw";
+  fovis_ros::DisparityOdometer odometer(ros::NodeHandle(), ros::NodeHandle("~"), transport);
+  odometer.start();
+  
+  ros::spin();
+  return 0;
+}
+
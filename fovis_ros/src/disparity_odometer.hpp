@@ -0,0 +1,144 @@
+#ifndef DISPARITY_ODOMETER_H_
+#define DISPARITY_ODOMETER_H_
+
+#include <ros/ros.h>
+#include <sensor_msgs/image_encodings.h>
+#include <image_geometry/pinhole_camera_model.h>
+
+#include <fovis_ros/FovisInfo.h>
+
+#include "disparity_processor.hpp"
+#include "odometer_base.hpp"
+#include "sparse_depth_image.hpp"
+#include "visualization.hpp"
+
+namespace fovis_ros
+{
+
+/**
+ * Odometer for a rectified image and a disparity image that has been
+ * computed already, e.g. by stereo_image_proc. Instead of matching the
+ * right image again like StereoOdometer, depth is computed from the
+ * referenced disparity message at the keypoints only.
+ */
+class DisparityOdometer : public DisparityProcessor, protected OdometerBase
+{
+
+private:
+
+  SparseDepthImage* sparse_depth_image_;
+
+  // disparity image of the current frame
+  DepthPreparation set_disparity_image_;
+  stereo_msgs::DisparityImageConstPtr disparity_msg_;
+
+public:
+
+  // OdometerBase holds fixed size Eigen members
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  DisparityOdometer(const ros::NodeHandle& nh, const ros::NodeHandle& local_nh,
+      const std::string& transport,
+      const SharedResources& shared = SharedResources()) :
+    DisparityProcessor(nh, local_nh, transport, shared.thread_pool),
+    OdometerBase(local_nh, shared),
+    sparse_depth_image_(NULL)
+  {
+    set_disparity_image_ = boost::bind(&DisparityOdometer::setDisparityImage, this);
+    warmStartFromCache(1);
+  }
+
+  ~DisparityOdometer()
+  {
+    unsubscribe();
+    stopPipeline();
+    stopPublisher();
+    if (sparse_depth_image_) delete sparse_depth_image_;
+  }
+
+  /**
+   * Starts publishing and subscribes to the input topics. Call this once
+   * the odometer is constructed, nothing is processed before.
+   */
+  void start()
+  {
+    startPublisher();
+    subscribe();
+  }
+
+protected:
+
+  SparseDepthImage* createDepthSource(
+      const sensor_msgs::CameraInfoConstPtr& info_msg,
+      const stereo_msgs::DisparityImageConstPtr& disparity_msg)
+  {
+    // read calibration info from camera info message
+    image_geometry::PinholeCameraModel model;
+    model.fromCameraInfo(*info_msg);
+
+    // initialize left camera parameters
+    fovis::CameraIntrinsicsParameters parameters;
+    rosToFovis(model, parameters);
+    adjustToImageRegion(parameters);
+
+    // the disparity image is registered to the left image,
+    // possibly at a lower resolution
+    int width = disparity_msg->image.width;
+    int height = disparity_msg->image.height;
+    return new SparseDepthImage(parameters, width, height,
+        getImageRegion().getRoi(width, height));
+  }
+
+  /**
+   * The size of the disparity image is only known with the first
+   * frame, the depth source is created in imageCallback().
+   */
+  fovis::DepthSource* createDepthSource(const CameraInfos& /*infos*/)
+  {
+    if (sparse_depth_image_) delete sparse_depth_image_;
+    sparse_depth_image_ = NULL;
+    return NULL;
+  }
+
+  void infoCallback(const sensor_msgs::CameraInfoConstPtr& info_msg, size_t index)
+  {
+    warmStart(info_msg, index, 1);
+  }
+
+  void imageCallback(
+      const sensor_msgs::ImageConstPtr& image_msg,
+      const stereo_msgs::DisparityImageConstPtr& disparity_msg,
+      const sensor_msgs::CameraInfoConstPtr& info_msg)
+  {
+    initialize(info_msg);
+    if (!sparse_depth_image_)
+    {
+      sparse_depth_image_ = createDepthSource(info_msg, disparity_msg);
+      setDepthSource(sparse_depth_image_);
+    }
+
+    // call base implementation, the disparity image is kept alive
+    // until processing is done
+    disparity_msg_ = disparity_msg;
+    if (!process(image_msg, getPipelineStatistics(),
+          set_disparity_image_))
+    {
+      ROS_ERROR("Disparity image must be in 32bit floating point format "
+                "and must not change its size!");
+    }
+    disparity_msg_.reset();
+  }
+
+  /**
+   * Passes the disparity image to the depth source, depth is only
+   * computed at the keypoints during processing.
+   */
+  bool setDisparityImage()
+  {
+    return sparse_depth_image_->setDisparityImage(disparity_msg_);
+  }
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,235 @@
+#ifndef DISPARITY_PROCESSOR_H_
+#define DISPARITY_PROCESSOR_H_
+
+#include <ros/ros.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <stereo_msgs/DisparityImage.h>
+
+#include <message_filters/subscriber.h>
+#include <message_filters/synchronizer.h>
+#include <message_filters/sync_policies/exact_time.h>
+#include <message_filters/sync_policies/approximate_time.h>
+#include <image_transport/subscriber_filter.h>
+
+#include <boost/scoped_ptr.hpp>
+
+#include "frame_pipeline.hpp"
+
+namespace fovis_ros
+{
+
+/**
+ * This is an abstract base class for nodes that process a rectified image
+ * together with a disparity image that has been computed already, e.g.
+ * by stereo_image_proc.
+ * It handles synchronization of input topics (approximate or exact)
+ * and checks for sync errors.
+ * To use this class, subclass it and implement the imageCallback() method.
+ */
+class DisparityProcessor
+{
+
+private:
+
+  // subscriber
+  ros::NodeHandle nh_;
+  std::string transport_;
+  image_transport::SubscriberFilter image_sub_;
+  message_filters::Subscriber<stereo_msgs::DisparityImage> disparity_sub_;
+  message_filters::Subscriber<sensor_msgs::CameraInfo> info_sub_;
+  typedef message_filters::sync_policies::ExactTime<sensor_msgs::Image, stereo_msgs::DisparityImage, sensor_msgs::CameraInfo> ExactPolicy;
+  typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::Image, stereo_msgs::DisparityImage, sensor_msgs::CameraInfo> ApproximatePolicy;
+  typedef message_filters::Synchronizer<ExactPolicy> ExactSync;
+  typedef message_filters::Synchronizer<ApproximatePolicy> ApproximateSync;
+  boost::shared_ptr<ExactSync> exact_sync_;
+  boost::shared_ptr<ApproximateSync> approximate_sync_;
+  int queue_size_;
+
+  // optional hand-over of tuples to a worker thread
+  typedef FramePipeline<sensor_msgs::Image, stereo_msgs::DisparityImage,
+          sensor_msgs::CameraInfo, message_filters::NullType> Pipeline;
+  boost::scoped_ptr<Pipeline> pipeline_;
+
+  // for sync checking
+  ros::WallTimer check_synced_timer_;
+  int image_received_, disparity_received_, info_received_, all_received_;
+
+  // for sync checking
+  static void increment(int* value)
+  {
+    ++(*value);
+  }
+
+  void dataCb(const sensor_msgs::ImageConstPtr& image_msg,
+              const stereo_msgs::DisparityImageConstPtr& disparity_msg,
+              const sensor_msgs::CameraInfoConstPtr& info_msg)
+  {
+
+    // For sync error checking
+    ++all_received_;
+
+    // call implementation directly or through the worker thread
+    if (pipeline_)
+      pipeline_->push(image_msg, disparity_msg, info_msg);
+    else
+      imageCallback(image_msg, disparity_msg, info_msg);
+  }
+
+  void checkInputsSynchronized()
+  {
+    int threshold = 3 * all_received_;
+    if (image_received_ >= threshold || disparity_received_ >= threshold ||
+        info_received_ >= threshold) {
+      ROS_WARN("[disparity_processor] Low number of synchronized image/disparity/camera_info tuples received.\n"
+               "Images received:            %d (topic '%s')\n"
+               "Disparity images received:  %d (topic '%s')\n"
+               "Camera info received:       %d (topic '%s')\n"
+               "Synchronized tuples: %d\n"
+               "Possible issues:\n"
+               "\t* stereo_image_proc is not running.\n"
+               "\t  Does `rosnode info %s` show any connections?\n"
+               "\t* The network is too slow. One or more images are dropped from each tuple.\n"
+               "\t  Try restarting the node, increasing parameter 'queue_size' (currently %d)",
+               image_received_, image_sub_.getTopic().c_str(),
+               disparity_received_, disparity_sub_.getTopic().c_str(),
+               info_received_, info_sub_.getTopic().c_str(),
+               all_received_, ros::this_node::getName().c_str(), queue_size_);
+    }
+  }
+
+
+protected:
+
+  /**
+   * Constructor, registers callbacks. Does not subscribe yet, see subscribe().
+   * \param nh The node handle used to resolve and subscribe to topics
+   * \param local_nh The private node handle used to read parameters
+   * \param transport The image transport to use for the intensity image
+   * \param thread_pool Shared pool that processes the tuples, if given
+   */
+  DisparityProcessor(const ros::NodeHandle& nh, const ros::NodeHandle& local_nh,
+      const std::string& transport,
+      const boost::shared_ptr<ThreadPool>& thread_pool = boost::shared_ptr<ThreadPool>()) :
+    nh_(nh), transport_(transport),
+    image_received_(0), disparity_received_(0), info_received_(0), all_received_(0)
+  {
+    // Count received messages for sync checking
+    image_sub_.registerCallback(boost::bind(DisparityProcessor::increment, &image_received_));
+    disparity_sub_.registerCallback(boost::bind(DisparityProcessor::increment, &disparity_received_));
+    info_sub_.registerCallback(boost::bind(DisparityProcessor::increment, &info_received_));
+
+    // Camera infos arrive before the first synchronized tuple
+    info_sub_.registerCallback(boost::bind(&DisparityProcessor::infoCallback, this, _1, 0));
+
+    // Optionally process tuples in a dedicated worker thread
+    // or on a pool shared with other odometers
+    bool pipelined;
+    local_nh.param("pipelined", pipelined, false);
+    if (thread_pool)
+    {
+      pipeline_.reset(new Pipeline(
+            boost::bind(&DisparityProcessor::imageCallback, this, _1, _2, _3), thread_pool));
+    }
+    else if (pipelined)
+    {
+      pipeline_.reset(new Pipeline(
+            boost::bind(&DisparityProcessor::imageCallback, this, _1, _2, _3)));
+    }
+
+    // Synchronize input topics. Optionally do approximate synchronization.
+    local_nh.param("queue_size", queue_size_, 5);
+    bool approx;
+    local_nh.param("approximate_sync", approx, false);
+    if (approx)
+    {
+      approximate_sync_.reset(new ApproximateSync(ApproximatePolicy(queue_size_),
+                                                  image_sub_, disparity_sub_, info_sub_) );
+      approximate_sync_->registerCallback(boost::bind(&DisparityProcessor::dataCb, this, _1, _2, _3));
+    }
+    else
+    {
+      exact_sync_.reset(new ExactSync(ExactPolicy(queue_size_),
+                                      image_sub_, disparity_sub_, info_sub_) );
+      exact_sync_->registerCallback(boost::bind(&DisparityProcessor::dataCb, this, _1, _2, _3));
+    }
+  }
+
+  /**
+   * Subscribes to the input topics. Callbacks may run on other threads
+   * as soon as this returns, so sub-classes must not call this before
+   * they are fully constructed.
+   */
+  void subscribe()
+  {
+    // Resolve topic names
+    std::string stereo_ns = nh_.resolveName("stereo");
+    std::string image_topic = ros::names::clean(stereo_ns + "/left/" + nh_.resolveName("image"));
+    std::string disparity_topic = ros::names::clean(stereo_ns + "/disparity");
+    std::string info_topic = stereo_ns + "/left/camera_info";
+
+    // Subscribe to three input topics.
+    ROS_INFO("Subscribing to:\n\t* %s\n\t* %s\n\t* %s",
+        image_topic.c_str(), disparity_topic.c_str(), info_topic.c_str());
+
+    image_transport::ImageTransport it(nh_);
+    image_sub_.subscribe(it, image_topic, 1, transport_);
+    disparity_sub_.subscribe(nh_, disparity_topic, 1);
+    info_sub_.subscribe(nh_, info_topic, 1);
+
+    // Complain every 15s if the topics appear unsynchronized
+    check_synced_timer_ = nh_.createWallTimer(ros::WallDuration(15.0),
+                                              boost::bind(&DisparityProcessor::checkInputsSynchronized, this));
+  }
+
+  /**
+   * Shuts down the subscribers, callbacks that are running are waited
+   * for. Sub-classes have to call this first in their destructor.
+   */
+  void unsubscribe()
+  {
+    check_synced_timer_.stop();
+    image_sub_.unsubscribe();
+    disparity_sub_.unsubscribe();
+    info_sub_.unsubscribe();
+  }
+
+  /**
+   * Stops the worker thread in pipelined mode. Sub-classes have to call
+   * this in their destructor before releasing resources that are used
+   * by imageCallback().
+   */
+  void stopPipeline()
+  {
+    if (pipeline_) pipeline_->stop();
+  }
+
+  /**
+   * Returns hand-over statistics for the tuple that is currently processed.
+   */
+  PipelineStatistics getPipelineStatistics() const
+  {
+    return pipeline_ ? pipeline_->getStatistics() : PipelineStatistics();
+  }
+
+  /**
+   * Called with every camera info message, with index 0, before
+   * synchronization. Override this to prepare for the first tuple.
+   */
+  virtual void infoCallback(const sensor_msgs::CameraInfoConstPtr& /*info_msg*/,
+                            size_t /*index*/)
+  {
+  }
+
+  /**
+   * Implement this method in sub-classes
+   */
+  virtual void imageCallback(const sensor_msgs::ImageConstPtr& image_msg,
+                             const stereo_msgs::DisparityImageConstPtr& disparity_msg,
+                             const sensor_msgs::CameraInfoConstPtr& info_msg) = 0;
+
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef FEATURE_PAINTER_H_
+#define FEATURE_PAINTER_H_
+
+#include <ros/ros.h>
+#include <std_msgs/Header.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/image_encodings.h>
+#include <image_transport/image_transport.h>
+#include <cv_bridge/cv_bridge.h>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "bounded_queue.hpp"
+#include "image_region.hpp"
+#include "message_pool.hpp"
+#include "visualization.hpp"
+
+namespace fovis_ros
+{
+
+/**
+ * Paints and publishes feature visualizations in a background thread.
+ * If painting is slower than new snapshots arrive, older unpainted
+ * snapshots are dropped. Snapshot buffers are passed back and forth
+ * between the odometer and the painter thread and keep their memory.
+ * The images are not copied by the odometer, the painter keeps the
+ * input messages and cuts out the processed region itself.
+ */
+class FeaturePainter
+{
+
+public:
+
+  typedef boost::shared_ptr<visualization::FeatureSnapshot> SnapshotPtr;
+
+  FeaturePainter(const image_transport::Publisher& publisher) :
+    publisher_(publisher),
+    image_msgs_(2),
+    queue_(1)
+  {
+    // one being painted, one queued and one being filled
+    for (int i = 0; i < 3; ++i)
+    {
+      snapshots_.push_back(SnapshotPtr(new visualization::FeatureSnapshot));
+    }
+    painter_thread_ = boost::thread(boost::bind(&FeaturePainter::run, this));
+  }
+
+  ~FeaturePainter()
+  {
+    queue_.shutdown();
+    if (painter_thread_.joinable()) painter_thread_.join();
+  }
+
+  /**
+   * Returns a snapshot buffer that is neither queued nor being painted,
+   * to be filled and pushed. Only to be called from one thread.
+   */
+  SnapshotPtr acquireSnapshot()
+  {
+    for (size_t i = 0; i < snapshots_.size(); ++i)
+    {
+      if (snapshots_[i].unique()) return snapshots_[i];
+    }
+    snapshots_.push_back(SnapshotPtr(new visualization::FeatureSnapshot));
+    return snapshots_.back();
+  }
+
+  /**
+   * Queues a snapshot for painting, never blocks.
+   * \param target_image_msg The image the snapshot was taken for
+   * \param reference_image_msg The image of the reference frame
+   * \param region The region of both images that fovis processed
+   */
+  void push(const sensor_msgs::ImageConstPtr& target_image_msg,
+      const sensor_msgs::ImageConstPtr& reference_image_msg,
+      const ImageRegion& region, const SnapshotPtr& snapshot)
+  {
+    Job job;
+    job.target_image_msg = target_image_msg;
+    job.reference_image_msg = reference_image_msg;
+    job.roi = region.getRoi();
+    job.downscale = region.getDownscale();
+    job.snapshot = snapshot;
+    queue_.push(job);
+  }
+
+private:
+
+  struct Job
+  {
+    sensor_msgs::ImageConstPtr target_image_msg;
+    sensor_msgs::ImageConstPtr reference_image_msg;
+    cv::Rect roi;
+    int downscale;
+    SnapshotPtr snapshot;
+  };
+
+  /**
+   * The level 0 image of a frame as fovis saw it, black if the message
+   * is missing or does not match the size of the snapshot.
+   * \param cv_ptr Keeps the converted message
+   * \param buffer Keeps the downscaled image
+   */
+  static cv::Mat getLevelImage(const Job& job,
+      const sensor_msgs::ImageConstPtr& image_msg,
+      cv_bridge::CvImageConstPtr& cv_ptr, cv::Mat& buffer)
+  {
+    cv::Size size(job.snapshot->width, job.snapshot->height);
+    if (image_msg &&
+        static_cast<int>(image_msg->width) >= job.roi.x + job.roi.width &&
+        static_cast<int>(image_msg->height) >= job.roi.y + job.roi.height &&
+        job.roi.width / job.downscale == size.width &&
+        job.roi.height / job.downscale == size.height)
+    {
+      cv::Mat image;
+      if (image_msg->encoding == sensor_msgs::image_encodings::MONO8)
+      {
+        // the job keeps the message, so its data stays valid
+        image = cv::Mat(image_msg->height, image_msg->width, CV_8UC1,
+            const_cast<uint8_t*>(&image_msg->data[0]), image_msg->step);
+      }
+      else
+      {
+        cv_ptr = cv_bridge::toCvShare(image_msg,
+            sensor_msgs::image_encodings::MONO8);
+        image = cv_ptr->image;
+      }
+      const cv::Mat region(image, job.roi);
+      if (job.downscale == 1)
+        return region;
+      cv::resize(region, buffer, size, 0, 0, cv::INTER_AREA);
+      return buffer;
+    }
+    buffer.create(size, CV_8UC1);
+    buffer.setTo(cv::Scalar(0));
+    return buffer;
+  }
+
+  void run()
+  {
+    Job job;
+    cv_bridge::CvImageConstPtr target_cv_ptr, reference_cv_ptr;
+    cv::Mat target_buffer, reference_buffer;
+    while (queue_.pop(job))
+    {
+      const cv::Mat target_image = getLevelImage(job,
+          job.target_image_msg, target_cv_ptr, target_buffer);
+      const cv::Mat reference_image = getLevelImage(job,
+          job.reference_image_msg, reference_cv_ptr, reference_buffer);
+
+      // paint straight into a message that keeps its buffer from an
+      // earlier frame, target above reference
+      MessagePool<sensor_msgs::Image>::Ptr image_msg = image_msgs_.acquire();
+      image_msg->header.stamp = job.target_image_msg->header.stamp;
+      image_msg->header.frame_id = job.target_image_msg->header.frame_id;
+      image_msg->width = job.snapshot->width;
+      image_msg->height = 2 * job.snapshot->height;
+      image_msg->encoding = sensor_msgs::image_encodings::BGR8;
+      image_msg->is_bigendian = 0;
+      image_msg->step = 3 * image_msg->width;
+      image_msg->data.resize(image_msg->step * image_msg->height);
+      cv::Mat canvas(image_msg->height, image_msg->width, CV_8UC3,
+          &image_msg->data[0], image_msg->step);
+      visualization::paint(*job.snapshot, target_image, reference_image,
+          canvas);
+      publisher_.publish(image_msg);
+
+      image_msg.reset();
+      target_cv_ptr.reset();
+      reference_cv_ptr.reset();
+      job = Job();
+    }
+  }
+
+  image_transport::Publisher publisher_;
+  // only acquired by the painter thread
+  MessagePool<sensor_msgs::Image> image_msgs_;
+  std::vector<SnapshotPtr> snapshots_;
+  BoundedQueue<Job> queue_;
+  boost::thread painter_thread_;
+};
+
+} // end of namespace
+
+#endif
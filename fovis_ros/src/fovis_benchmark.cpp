@@ -0,0 +1,407 @@
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <message_filters/simple_filter.h>
+#include <message_filters/synchronizer.h>
+#include <message_filters/sync_policies/exact_time.h>
+#include <message_filters/sync_policies/approximate_time.h>
+
+#include "stereo_odometer.hpp"
+#include "mono_depth_odometer.hpp"
+
+namespace fovis_ros
+{
+
+/**
+ * Collects samples of a quantity and computes statistics over them.
+ */
+class Samples
+{
+
+public:
+
+  void add(double value)
+  {
+    values_.push_back(value);
+  }
+
+  size_t size() const
+  {
+    return values_.size();
+  }
+
+  double mean() const
+  {
+    if (values_.empty()) return 0.0;
+    double sum = 0.0;
+    for (size_t i = 0; i < values_.size(); ++i) sum += values_[i];
+    return sum / values_.size();
+  }
+
+  /**
+   * \param p The percentile between 0 and 1
+   */
+  double percentile(double p) const
+  {
+    if (values_.empty()) return 0.0;
+    std::vector<double> sorted(values_);
+    std::sort(sorted.begin(), sorted.end());
+    size_t index = std::min(sorted.size() - 1,
+        static_cast<size_t>(p * sorted.size()));
+    return sorted[index];
+  }
+
+  double max() const
+  {
+    if (values_.empty()) return 0.0;
+    return *std::max_element(values_.begin(), values_.end());
+  }
+
+private:
+
+  std::vector<double> values_;
+};
+
+/**
+ * Feeds messages read from a bag into message filters.
+ */
+template <class M>
+class BagSubscriber : public message_filters::SimpleFilter<M>
+{
+
+public:
+
+  void newMessage(const boost::shared_ptr<M const>& msg)
+  {
+    this->signalMessage(msg);
+  }
+};
+
+struct BenchmarkResults
+{
+  BenchmarkResults() :
+    num_frames(0),
+    num_failures(0),
+    first_frame_time(0.0),
+    wall_time(0.0)
+  {
+  }
+
+  int num_frames;
+  int num_failures;
+  // the first frame initializes the odometer and is not part of latency
+  double first_frame_time;
+  double wall_time;
+  Samples latency;
+  std::map<std::string, Samples> stages;
+  fovis::VisualOdometryOptions options;
+};
+
+/**
+ * Odometer that is fed by the benchmark instead of its subscribers and
+ * records the results of every frame. It is never started, so it does
+ * not subscribe to any topic.
+ */
+template <class Odometer>
+class BenchmarkOdometer : public Odometer
+{
+
+public:
+
+  BenchmarkOdometer(const ros::NodeHandle& nh, const ros::NodeHandle& local_nh,
+      BenchmarkResults& results) :
+    Odometer(nh, local_nh, "raw"),
+    results_(results)
+  {
+    // statistics are collected from the info of every frame
+    this->setInfoRequired(true);
+    // measuring per frame latency needs the synchronous code path
+    this->setPipelined(false);
+  }
+
+  void processTuple(
+      const sensor_msgs::ImageConstPtr& image_msg_1,
+      const sensor_msgs::ImageConstPtr& image_msg_2,
+      const sensor_msgs::CameraInfoConstPtr& info_msg_1,
+      const sensor_msgs::CameraInfoConstPtr& info_msg_2)
+  {
+    ros::WallTime start_time = ros::WallTime::now();
+    this->imageCallback(image_msg_1, image_msg_2, info_msg_1, info_msg_2);
+    double elapsed = (ros::WallTime::now() - start_time).toSec();
+    if (results_.num_frames == 0)
+      results_.first_frame_time = elapsed;
+    else
+      results_.latency.add(elapsed);
+    ++results_.num_frames;
+  }
+
+  const fovis::VisualOdometryOptions& getVisualOdometryOptions() const
+  {
+    return this->getOptions();
+  }
+
+protected:
+
+  virtual void onInfo(const FovisInfo& info)
+  {
+    if (results_.num_frames == 0) return;
+    if (info.motion_estimate_status_code != fovis::SUCCESS)
+      ++results_.num_failures;
+    results_.stages["image_conversion"].add(info.image_conversion_time);
+    results_.stages["depth_preparation"].add(info.depth_preparation_time);
+    results_.stages["feature_detection"].add(info.feature_detection_time);
+    results_.stages["depth"].add(info.depth_time);
+    results_.stages["matching"].add(info.matching_time);
+    results_.stages["depth_refinement"].add(info.depth_refinement_time);
+    results_.stages["motion_estimation"].add(info.motion_estimation_time);
+    results_.stages["visualization"].add(info.visualization_time);
+    results_.stages["tf_lookup"].add(info.tf_lookup_time);
+  }
+
+private:
+
+  BenchmarkResults& results_;
+};
+
+/**
+ * Reads the given topics from the bag, synchronizes them like the
+ * processors do and passes all tuples to the odometer as fast as possible.
+ * \param topics The two image topics followed by their camera info topics
+ */
+template <class Odometer>
+void runBenchmark(const std::string& bag_file,
+    const std::vector<std::string>& topics, bool approximate,
+    int queue_size, BenchmarkResults& results)
+{
+  ros::NodeHandle nh;
+  ros::NodeHandle local_nh("~");
+  BenchmarkOdometer<Odometer> odometer(nh, local_nh, results);
+
+  BagSubscriber<sensor_msgs::Image> image_sub_1, image_sub_2;
+  BagSubscriber<sensor_msgs::CameraInfo> info_sub_1, info_sub_2;
+  typedef message_filters::sync_policies::ExactTime<sensor_msgs::Image, sensor_msgs::Image, sensor_msgs::CameraInfo, sensor_msgs::CameraInfo> ExactPolicy;
+  typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::Image, sensor_msgs::Image, sensor_msgs::CameraInfo, sensor_msgs::CameraInfo> ApproximatePolicy;
+  typedef message_filters::Synchronizer<ExactPolicy> ExactSync;
+  typedef message_filters::Synchronizer<ApproximatePolicy> ApproximateSync;
+  boost::shared_ptr<ExactSync> exact_sync;
+  boost::shared_ptr<ApproximateSync> approximate_sync;
+  if (approximate)
+  {
+    approximate_sync.reset(new ApproximateSync(ApproximatePolicy(queue_size),
+          image_sub_1, image_sub_2, info_sub_1, info_sub_2));
+    approximate_sync->registerCallback(boost::bind(
+          &BenchmarkOdometer<Odometer>::processTuple, &odometer, _1, _2, _3, _4));
+  }
+  else
+  {
+    exact_sync.reset(new ExactSync(ExactPolicy(queue_size),
+          image_sub_1, image_sub_2, info_sub_1, info_sub_2));
+    exact_sync->registerCallback(boost::bind(
+          &BenchmarkOdometer<Odometer>::processTuple, &odometer, _1, _2, _3, _4));
+  }
+
+  rosbag::Bag bag(bag_file, rosbag::bagmode::Read);
+  rosbag::View view(bag, rosbag::TopicQuery(topics));
+  ros::WallTime start_time = ros::WallTime::now();
+  for (rosbag::View::iterator it = view.begin(); it != view.end() && ros::ok(); ++it)
+  {
+    const std::string& topic = it->getTopic();
+    if (topic == topics[0] || topic == topics[1])
+    {
+      sensor_msgs::ImageConstPtr msg = it->instantiate<sensor_msgs::Image>();
+      if (!msg) continue;
+      if (topic == topics[0])
+        image_sub_1.newMessage(msg);
+      else
+        image_sub_2.newMessage(msg);
+    }
+    else
+    {
+      sensor_msgs::CameraInfoConstPtr msg = it->instantiate<sensor_msgs::CameraInfo>();
+      if (!msg) continue;
+      if (topic == topics[2])
+        info_sub_1.newMessage(msg);
+      else
+        info_sub_2.newMessage(msg);
+    }
+  }
+  results.wall_time = (ros::WallTime::now() - start_time).toSec();
+  results.options = odometer.getVisualOdometryOptions();
+  bag.close();
+}
+
+std::string escapeJson(const std::string& str)
+{
+  std::string escaped;
+  for (size_t i = 0; i < str.size(); ++i)
+  {
+    if (str[i] == '"' || str[i] == '\\') escaped += '\\';
+    escaped += str[i];
+  }
+  return escaped;
+}
+
+void writeJson(std::ostream& out, const std::string& mode,
+    const std::string& bag_file, const BenchmarkResults& results,
+    long peak_rss_kb)
+{
+  out << std::setprecision(9);
+  out << "{\n";
+  out << "  \"mode\": \"" << mode << "\",\n";
+  out << "  \"bag\": \"" << escapeJson(bag_file) << "\",\n";
+  out << "  \"num_frames\": " << results.num_frames << ",\n";
+  out << "  \"num_failures\": " << results.num_failures << ",\n";
+  out << "  \"wall_time\": " << results.wall_time << ",\n";
+  out << "  \"frames_per_second\": " <<
+    (results.wall_time > 0.0 ? results.num_frames / results.wall_time : 0.0) << ",\n";
+  out << "  \"first_frame_time\": " << results.first_frame_time << ",\n";
+  out << "  \"latency\": {\"mean\": " << results.latency.mean() <<
+    ", \"p50\": " << results.latency.percentile(0.5) <<
+    ", \"p95\": " << results.latency.percentile(0.95) <<
+    ", \"p99\": " << results.latency.percentile(0.99) <<
+    ", \"max\": " << results.latency.max() << "},\n";
+  out << "  \"stages\": {";
+  for (std::map<std::string, Samples>::const_iterator it = results.stages.begin();
+      it != results.stages.end(); ++it)
+  {
+    out << (it == results.stages.begin() ? "\n" : ",\n");
+    out << "    \"" << it->first << "\": {\"mean\": " << it->second.mean() <<
+      ", \"p50\": " << it->second.percentile(0.5) <<
+      ", \"p95\": " << it->second.percentile(0.95) <<
+      ", \"p99\": " << it->second.percentile(0.99) << "}";
+  }
+  out << "\n  },\n";
+  out << "  \"peak_rss_kb\": " << peak_rss_kb << ",\n";
+  out << "  \"options\": {";
+  for (fovis::VisualOdometryOptions::const_iterator it = results.options.begin();
+      it != results.options.end(); ++it)
+  {
+    out << (it == results.options.begin() ? "\n" : ",\n");
+    out << "    \"" << escapeJson(it->first) << "\": \"" <<
+      escapeJson(it->second) << "\"";
+  }
+  out << "\n  }\n";
+  out << "}\n";
+}
+
+void printSummary(const BenchmarkResults& results, long peak_rss_kb)
+{
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << "Frames:           " << results.num_frames <<
+    " (" << results.num_failures << " failed)\n";
+  std::cout << "Frames/sec:       " <<
+    (results.wall_time > 0.0 ? results.num_frames / results.wall_time : 0.0) << "\n";
+  std::cout << "First frame [ms]: " << 1000 * results.first_frame_time << "\n";
+  std::cout << "Latency [ms]:     mean " << 1000 * results.latency.mean() <<
+    "  p50 " << 1000 * results.latency.percentile(0.5) <<
+    "  p95 " << 1000 * results.latency.percentile(0.95) <<
+    "  p99 " << 1000 * results.latency.percentile(0.99) <<
+    "  max " << 1000 * results.latency.max() << "\n";
+  std::cout << "Stages [ms]:\n";
+  for (std::map<std::string, Samples>::const_iterator it = results.stages.begin();
+      it != results.stages.end(); ++it)
+  {
+    std::cout << "  " << std::left << std::setw(20) << it->first << std::right <<
+      "mean " << 1000 * it->second.mean() <<
+      "  p95 " << 1000 * it->second.percentile(0.95) << "\n";
+  }
+  std::cout << "Peak RSS [kB]:    " << peak_rss_kb << std::endl;
+}
+
+} // end of namespace
+
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "fovis_benchmark", ros::init_options::AnonymousName);
+  if (argc < 3 || (std::string(argv[1]) != "stereo" &&
+                   std::string(argv[1]) != "mono_depth"))
+  {
+    std::cerr << "Usage: fovis_benchmark <stereo|mono_depth> <bag file> "
+                 "[<json output file>]\n"
+                 "Topics are resolved like in stereo_odometer and "
+                 "mono_depth_odometer, e.g.\n"
+                 "\t$ rosrun fovis_ros fovis_benchmark stereo stereo.bag "
+                 "result.json stereo:=narrow_stereo image:=image_rect\n"
+                 "Odometry parameters are read from the private namespace, "
+                 "e.g. _fast_threshold:=\"'20'\"" << std::endl;
+    return 1;
+  }
+  std::string mode = argv[1];
+  std::string bag_file = argv[2];
+  std::string output_file = argc > 3 ? argv[3] : "";
+
+  ros::NodeHandle nh;
+  ros::NodeHandle local_nh("~");
+  int queue_size;
+  local_nh.param("queue_size", queue_size, 5);
+
+  // resolve topics the same way the processors do
+  std::vector<std::string> topics;
+  bool approximate_sync;
+  if (mode == "stereo")
+  {
+    std::string stereo_ns = nh.resolveName("stereo");
+    topics.push_back(ros::names::clean(stereo_ns + "/left/" + nh.resolveName("image")));
+    topics.push_back(ros::names::clean(stereo_ns + "/right/" + nh.resolveName("image")));
+    topics.push_back(stereo_ns + "/left/camera_info");
+    topics.push_back(stereo_ns + "/right/camera_info");
+    local_nh.param("approximate_sync", approximate_sync, false);
+  }
+  else
+  {
+    std::string camera_ns = nh.resolveName("camera");
+    topics.push_back(ros::names::clean(camera_ns + "/rgb/image_rect"));
+    topics.push_back(ros::names::clean(camera_ns + "/depth_registered/image_rect"));
+    topics.push_back(camera_ns + "/rgb/camera_info");
+    topics.push_back(camera_ns + "/depth_registered/camera_info");
+    local_nh.param("approximate_sync", approximate_sync, true);
+  }
+  ROS_INFO("Reading from %s:\n\t* %s\n\t* %s\n\t* %s\n\t* %s", bag_file.c_str(),
+      topics[0].c_str(), topics[1].c_str(), topics[2].c_str(), topics[3].c_str());
+
+  fovis_ros::BenchmarkResults results;
+  try
+  {
+    if (mode == "stereo")
+    {
+      fovis_ros::runBenchmark<fovis_ros::StereoOdometer>(
+          bag_file, topics, approximate_sync, queue_size, results);
+    }
+    else
+    {
+      fovis_ros::runBenchmark<fovis_ros::MonoDepthOdometer>(
+          bag_file, topics, approximate_sync, queue_size, results);
+    }
+  }
+  catch (const rosbag::BagException& e)
+  {
+    ROS_ERROR("Could not read bag file '%s': %s", bag_file.c_str(), e.what());
+    return 1;
+  }
+
+  // ru_maxrss is given in kilobytes on Linux
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  long peak_rss_kb = usage.ru_maxrss;
+
+  fovis_ros::printSummary(results, peak_rss_kb);
+  if (!output_file.empty())
+  {
+    std::ofstream out(output_file.c_str());
+    if (!out)
+    {
+      ROS_ERROR("Could not open '%s' for writing.", output_file.c_str());
+      return 1;
+    }
+    fovis_ros::writeJson(out, mode, bag_file, results, peak_rss_kb);
+  }
+  return 0;
+}
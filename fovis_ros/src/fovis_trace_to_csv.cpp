@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "trace_recorder.hpp"
+
+using fovis_ros::TraceHeader;
+using fovis_ros::TraceRecord;
+
+static void printHeader(FILE* out)
+{
+  std::fprintf(out, "stamp,x,y,z,qx,qy,qz,qw,vx,vy,vz,wx,wy,wz");
+  for (int i = 0; i < 36; ++i) std::fprintf(out, ",pose_cov_%d", i);
+  for (int i = 0; i < 36; ++i) std::fprintf(out, ",twist_cov_%d", i);
+  std::fprintf(out, ",runtime,queue_wait_time,image_conversion_time,"
+      "depth_preparation_time,feature_detection_time,depth_time,matching_time,"
+      "depth_refinement_time,motion_estimation_time,visualization_time,"
+      "tf_lookup_time,motion_estimate_status_code,motion_estimate_valid,"
+      "change_reference_frame,motion_prior_used,fast_threshold,num_matches,"
+      "num_inliers,num_reprojection_failures,num_total_detected_keypoints,"
+      "num_total_keypoints,num_skipped_frames,num_dropped_tuples");
+  for (int i = 0; i < TraceRecord::MAX_LEVELS; ++i)
+    std::fprintf(out, ",num_detected_keypoints_%d", i);
+  for (int i = 0; i < TraceRecord::MAX_LEVELS; ++i)
+    std::fprintf(out, ",num_keypoints_%d", i);
+  std::fprintf(out, "\n");
+}
+
+static void printRecord(FILE* out, const TraceRecord& r)
+{
+  std::fprintf(out, "%.9f", r.stamp);
+  for (int i = 0; i < 3; ++i) std::fprintf(out, ",%.9g", r.position[i]);
+  for (int i = 0; i < 4; ++i) std::fprintf(out, ",%.9g", r.orientation[i]);
+  for (int i = 0; i < 3; ++i) std::fprintf(out, ",%.9g", r.linear_velocity[i]);
+  for (int i = 0; i < 3; ++i) std::fprintf(out, ",%.9g", r.angular_velocity[i]);
+  for (int i = 0; i < 36; ++i) std::fprintf(out, ",%.9g", r.pose_covariance[i]);
+  for (int i = 0; i < 36; ++i) std::fprintf(out, ",%.9g", r.twist_covariance[i]);
+  std::fprintf(out, ",%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g",
+      r.runtime, r.queue_wait_time, r.image_conversion_time,
+      r.depth_preparation_time, r.feature_detection_time, r.depth_time,
+      r.matching_time, r.depth_refinement_time, r.motion_estimation_time,
+      r.visualization_time, r.tf_lookup_time);
+  std::fprintf(out, ",%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d",
+      r.motion_estimate_status_code,
+      (r.flags & TraceRecord::MOTION_ESTIMATE_VALID) ? 1 : 0,
+      (r.flags & TraceRecord::CHANGE_REFERENCE_FRAME) ? 1 : 0,
+      (r.flags & TraceRecord::MOTION_PRIOR_USED) ? 1 : 0,
+      r.fast_threshold, r.num_matches, r.num_inliers,
+      r.num_reprojection_failures, r.num_total_detected_keypoints,
+      r.num_total_keypoints, r.num_skipped_frames, r.num_dropped_tuples);
+  for (int i = 0; i < TraceRecord::MAX_LEVELS; ++i)
+    std::fprintf(out, ",%d", r.num_detected_keypoints[i]);
+  for (int i = 0; i < TraceRecord::MAX_LEVELS; ++i)
+    std::fprintf(out, ",%d", r.num_keypoints[i]);
+  std::fprintf(out, "\n");
+}
+
+/**
+ * Converts a trace written with ~trace_file to CSV, oldest frame first.
+ */
+int main(int argc, char **argv)
+{
+  if (argc < 2 || argc > 3)
+  {
+    std::fprintf(stderr, "Usage: %s <trace file> [<csv file>]\n"
+        "Writes to stdout if no csv file is given.\n", argv[0]);
+    return 1;
+  }
+
+  FILE* in = std::fopen(argv[1], "rb");
+  if (!in)
+  {
+    std::fprintf(stderr, "Cannot open '%s': %s\n", argv[1], std::strerror(errno));
+    return 1;
+  }
+  TraceHeader header;
+  if (std::fread(&header, sizeof(header), 1, in) != 1 ||
+      std::memcmp(header.magic, fovis_ros::TRACE_MAGIC, sizeof(header.magic)) != 0)
+  {
+    std::fprintf(stderr, "'%s' is not a fovis_ros trace file.\n", argv[1]);
+    std::fclose(in);
+    return 1;
+  }
+  if (header.version != TraceHeader::VERSION ||
+      header.record_size != sizeof(TraceRecord) || header.capacity == 0)
+  {
+    std::fprintf(stderr, "'%s' has version %u with %u byte records, this tool "
+        "reads version %u with %u byte records.\n", argv[1], header.version,
+        header.record_size, TraceHeader::VERSION,
+        static_cast<unsigned int>(sizeof(TraceRecord)));
+    std::fclose(in);
+    return 1;
+  }
+
+  std::vector<TraceRecord> records(header.capacity);
+  size_t num_read = std::fread(&records[0], sizeof(TraceRecord), records.size(), in);
+  std::fclose(in);
+  if (num_read != records.size())
+  {
+    std::fprintf(stderr, "'%s' is truncated.\n", argv[1]);
+    return 1;
+  }
+
+  FILE* out = argc > 2 ? std::fopen(argv[2], "w") : stdout;
+  if (!out)
+  {
+    std::fprintf(stderr, "Cannot open '%s': %s\n", argv[2], std::strerror(errno));
+    return 1;
+  }
+  uint64_t num_written = header.num_written;
+  uint64_t num_records = std::min(num_written, header.capacity);
+  uint64_t first = num_written - num_records;
+  printHeader(out);
+  for (uint64_t i = first; i < num_written; ++i)
+  {
+    printRecord(out, records[i % header.capacity]);
+  }
+  if (out != stdout) std::fclose(out);
+  std::fprintf(stderr, "Converted %lu of %lu recorded frames.\n",
+      static_cast<unsigned long>(num_records),
+      static_cast<unsigned long>(num_written));
+  return 0;
+}
@@ -0,0 +1,239 @@
+#ifndef FRAME_PIPELINE_H_
+#define FRAME_PIPELINE_H_
+
+#include <ros/ros.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/CameraInfo.h>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "bounded_queue.hpp"
+#include "thread_pool.hpp"
+
+namespace fovis_ros
+{
+
+/**
+ * Statistics about the hand-over of input tuples to the odometry.
+ */
+struct PipelineStatistics
+{
+  PipelineStatistics() : queue_wait_time(0.0), num_dropped_tuples(0) {}
+
+  /// time the current tuple waited for the worker in seconds
+  double queue_wait_time;
+  /// number of tuples overwritten before the worker got them, since start
+  int num_dropped_tuples;
+};
+
+/**
+ * Decouples the receipt of synchronized image tuples from their processing.
+ * Tuples are put into a "latest wins" slot and processed by a dedicated
+ * worker thread, tuples that arrive while the worker is busy replace older
+ * unprocessed ones. Optionally the slot is drained by a task on a thread
+ * pool that is shared with other pipelines instead, so idle odometers do
+ * not hold a thread and busy ones can use all threads of the pool. At most
+ * one task per pipeline is scheduled, tuples are still processed in order.
+ * The message types default to two images with camera infos, processors
+ * with fewer inputs pass empty pointers for the remaining ones.
+ */
+template <typename M1 = sensor_msgs::Image, typename M2 = sensor_msgs::Image,
+          typename M3 = sensor_msgs::CameraInfo,
+          typename M4 = sensor_msgs::CameraInfo>
+class FramePipeline
+{
+
+public:
+
+  typedef boost::shared_ptr<const M1> M1ConstPtr;
+  typedef boost::shared_ptr<const M2> M2ConstPtr;
+  typedef boost::shared_ptr<const M3> M3ConstPtr;
+  typedef boost::shared_ptr<const M4> M4ConstPtr;
+
+  typedef boost::function<void (
+      const M1ConstPtr&,
+      const M2ConstPtr&,
+      const M3ConstPtr&,
+      const M4ConstPtr&)> Callback;
+
+  /**
+   * Starts the worker thread.
+   * \param callback Called from the worker thread for each tuple
+   */
+  FramePipeline(const Callback& callback) :
+    callback_(callback),
+    slot_(1),
+    scheduled_(false),
+    stopped_(false),
+    queue_wait_time_(0.0),
+    num_dropped_tuples_(0)
+  {
+    worker_thread_ = boost::thread(boost::bind(&FramePipeline::run, this));
+  }
+
+  /**
+   * Processes the tuples on a shared thread pool, no thread is started.
+   * \param callback Called from one of the pool threads for each tuple
+   * \param thread_pool Pool that has at least one worker thread
+   */
+  FramePipeline(const Callback& callback,
+      const boost::shared_ptr<ThreadPool>& thread_pool) :
+    callback_(callback),
+    slot_(1),
+    thread_pool_(thread_pool),
+    scheduled_(false),
+    stopped_(false),
+    queue_wait_time_(0.0),
+    num_dropped_tuples_(0)
+  {
+    drain_task_ = boost::bind(&FramePipeline::drain, this);
+  }
+
+  ~FramePipeline()
+  {
+    stop();
+  }
+
+  /**
+   * Hands a tuple over to the worker thread, never blocks.
+   */
+  void push(const M1ConstPtr& msg_1,
+            const M2ConstPtr& msg_2,
+            const M3ConstPtr& msg_3,
+            const M4ConstPtr& msg_4 = M4ConstPtr())
+  {
+    Tuple tuple;
+    tuple.msg_1 = msg_1;
+    tuple.msg_2 = msg_2;
+    tuple.msg_3 = msg_3;
+    tuple.msg_4 = msg_4;
+    tuple.receipt_time = ros::WallTime::now();
+    bool dropped;
+    if (thread_pool_)
+    {
+      // pushing and scheduling under the same lock as the check in
+      // drain(), so no tuple is left behind when the task finishes
+      boost::mutex::scoped_lock lock(schedule_mutex_);
+      dropped = slot_.push(tuple);
+      if (!scheduled_ && !stopped_)
+      {
+        scheduled_ = true;
+        thread_pool_->post(drain_task_);
+      }
+    }
+    else
+    {
+      dropped = slot_.push(tuple);
+    }
+    if (dropped)
+    {
+      boost::mutex::scoped_lock lock(statistics_mutex_);
+      ++num_dropped_tuples_;
+    }
+  }
+
+  /**
+   * Stops the worker thread, a tuple that is currently being processed
+   * is finished first.
+   */
+  void stop()
+  {
+    slot_.shutdown();
+    if (worker_thread_.joinable()) worker_thread_.join();
+    boost::mutex::scoped_lock lock(schedule_mutex_);
+    stopped_ = true;
+    while (scheduled_)
+    {
+      drained_condition_.wait(lock);
+    }
+  }
+
+  /**
+   * Returns the statistics for the tuple that is currently processed,
+   * only valid when called from within the callback.
+   */
+  PipelineStatistics getStatistics() const
+  {
+    PipelineStatistics statistics;
+    statistics.queue_wait_time = queue_wait_time_;
+    boost::mutex::scoped_lock lock(statistics_mutex_);
+    statistics.num_dropped_tuples = num_dropped_tuples_;
+    return statistics;
+  }
+
+private:
+
+  struct Tuple
+  {
+    M1ConstPtr msg_1;
+    M2ConstPtr msg_2;
+    M3ConstPtr msg_3;
+    M4ConstPtr msg_4;
+    ros::WallTime receipt_time;
+  };
+
+  void run()
+  {
+    Tuple tuple;
+    while (slot_.pop(tuple))
+    {
+      queue_wait_time_ = (ros::WallTime::now() - tuple.receipt_time).toSec();
+      callback_(tuple.msg_1, tuple.msg_2, tuple.msg_3, tuple.msg_4);
+      // release the messages while waiting for the next tuple
+      tuple = Tuple();
+    }
+  }
+
+  /**
+   * Pool task, processes tuples until the slot is empty.
+   */
+  void drain()
+  {
+    Tuple tuple;
+    while (true)
+    {
+      {
+        boost::mutex::scoped_lock lock(schedule_mutex_);
+        if (!slot_.tryPop(tuple))
+        {
+          scheduled_ = false;
+          drained_condition_.notify_all();
+          return;
+        }
+      }
+      queue_wait_time_ = (ros::WallTime::now() - tuple.receipt_time).toSec();
+      // posted tasks must not throw
+      try
+      {
+        callback_(tuple.msg_1, tuple.msg_2, tuple.msg_3, tuple.msg_4);
+      }
+      catch (const std::exception& e)
+      {
+        ROS_ERROR("Processing of a tuple failed: %s", e.what());
+      }
+      tuple = Tuple();
+    }
+  }
+
+  Callback callback_;
+  BoundedQueue<Tuple> slot_;
+  boost::thread worker_thread_;
+
+  // shared pool mode
+  boost::shared_ptr<ThreadPool> thread_pool_;
+  ThreadPool::IndexedTask drain_task_;
+  bool scheduled_;
+  bool stopped_;
+  boost::mutex schedule_mutex_;
+  boost::condition_variable drained_condition_;
+
+  double queue_wait_time_;
+  int num_dropped_tuples_;
+  mutable boost::mutex statistics_mutex_;
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef IMAGE_REGION_H_
+#define IMAGE_REGION_H_
+
+#include <algorithm>
+
+#include <ros/ros.h>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <fovis/camera_intrinsics.hpp>
+
+namespace fovis_ros
+{
+
+/**
+ * Region of interest and integer downscale factor that are applied to
+ * the input images before they are passed to fovis. The region is cut
+ * out as a view on the input buffer, only downscaling and cropping of
+ * columns need a copy as fovis expects packed rows.
+ */
+class ImageRegion
+{
+
+public:
+
+  ImageRegion() :
+    requested_roi_(0, 0, 0, 0),
+    roi_(0, 0, 0, 0),
+    downscale_(1),
+    initialized_(false)
+  {
+  }
+
+  /**
+   * Reads ~roi_x_offset, ~roi_y_offset, ~roi_width, ~roi_height and
+   * ~downscale, a width or height of 0 means up to the image border.
+   */
+  void loadParams(const ros::NodeHandle& local_nh)
+  {
+    local_nh.param("roi_x_offset", requested_roi_.x, 0);
+    local_nh.param("roi_y_offset", requested_roi_.y, 0);
+    local_nh.param("roi_width", requested_roi_.width, 0);
+    local_nh.param("roi_height", requested_roi_.height, 0);
+    local_nh.param("downscale", downscale_, 1);
+    if (downscale_ < 1)
+    {
+      ROS_WARN("~downscale must be at least 1, ignoring it.");
+      downscale_ = 1;
+    }
+  }
+
+  /**
+   * Fits the region into an image of the given size, the first call
+   * fixes the region until reset(), later calls only check the size.
+   */
+  void setImageSize(int width, int height)
+  {
+    if (initialized_)
+    {
+      ROS_ASSERT(width == image_width_ && height == image_height_);
+      return;
+    }
+    image_width_ = width;
+    image_height_ = height;
+    cv::Rect roi = requested_roi_;
+    if (roi.width <= 0) roi.width = width - roi.x;
+    if (roi.height <= 0) roi.height = height - roi.y;
+    roi &= cv::Rect(0, 0, width, height);
+    // the region has to be a multiple of the downscale factor
+    roi.width -= roi.width % downscale_;
+    roi.height -= roi.height % downscale_;
+    if (roi.width <= 0 || roi.height <= 0)
+    {
+      ROS_ERROR("Region of interest is outside of the %dx%d image, "
+                "using the full image.", width, height);
+      roi = cv::Rect(0, 0, width - width % downscale_,
+                     height - height % downscale_);
+    }
+    if (roi != cv::Rect(0, 0, width, height) || downscale_ > 1)
+    {
+      ROS_INFO("Processing region %dx%d+%d+%d of the %dx%d image, "
+               "downscaled by %d.", roi.width, roi.height, roi.x, roi.y,
+               width, height, downscale_);
+    }
+    roi_ = roi;
+    initialized_ = true;
+  }
+
+  /**
+   * Forgets the image size, the next call to setImageSize() or adjust()
+   * fits the region again, e.g. after the camera resolution changed.
+   */
+  void reset()
+  {
+    initialized_ = false;
+  }
+
+  /**
+   * Adjusts the intrinsics of the full image to the processed image,
+   * the size of the full image is taken from the parameters.
+   */
+  void adjust(fovis::CameraIntrinsicsParameters& parameters)
+  {
+    setImageSize(parameters.width, parameters.height);
+    // pixel centers of the downscaled image lie in the middle
+    // of the downscale_ x downscale_ blocks they are averaged from
+    double offset = 0.5 * (downscale_ - 1);
+    parameters.cx = (parameters.cx - roi_.x - offset) / downscale_;
+    parameters.cy = (parameters.cy - roi_.y - offset) / downscale_;
+    parameters.fx /= downscale_;
+    parameters.fy /= downscale_;
+    parameters.width = roi_.width / downscale_;
+    parameters.height = roi_.height / downscale_;
+  }
+
+  /**
+   * The region in pixels of the full image.
+   */
+  const cv::Rect& getRoi() const
+  {
+    ROS_ASSERT(initialized_);
+    return roi_;
+  }
+
+  /**
+   * The same region in an image of another resolution that covers the
+   * same view, e.g. a registered depth image.
+   */
+  cv::Rect getRoi(int width, int height) const
+  {
+    ROS_ASSERT(initialized_);
+    double scale_x = static_cast<double>(width) / image_width_;
+    double scale_y = static_cast<double>(height) / image_height_;
+    return cv::Rect(
+        static_cast<int>(roi_.x * scale_x + 0.5),
+        static_cast<int>(roi_.y * scale_y + 0.5),
+        static_cast<int>(roi_.width * scale_x + 0.5),
+        static_cast<int>(roi_.height * scale_y + 0.5)) &
+      cv::Rect(0, 0, width, height);
+  }
+
+  int getDownscale() const
+  {
+    return downscale_;
+  }
+
+  /**
+   * True if images are passed to fovis as they are.
+   */
+  bool isFullImage() const
+  {
+    return roi_ == cv::Rect(0, 0, image_width_, image_height_) &&
+      downscale_ == 1;
+  }
+
+private:
+
+  // as configured and as fitted into the image
+  cv::Rect requested_roi_;
+  cv::Rect roi_;
+  int downscale_;
+  bool initialized_;
+  int image_width_;
+  int image_height_;
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef MESSAGE_POOL_H_
+#define MESSAGE_POOL_H_
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+namespace fovis_ros
+{
+
+/**
+ * Messages that are published by shared pointer and reused once nobody
+ * holds them anymore, so publishing neither allocates a new message nor
+ * copies it for subscribers in the same process. A message that is still
+ * referenced, e.g. queued by a nodelet subscriber, is never touched.
+ * Only one thread may acquire messages.
+ */
+template <typename M>
+class MessagePool
+{
+
+public:
+
+  typedef boost::shared_ptr<M> Ptr;
+
+  MessagePool(size_t initial_size)
+  {
+    for (size_t i = 0; i < initial_size; ++i)
+    {
+      messages_.push_back(Ptr(new M));
+    }
+  }
+
+  /**
+   * Returns a message that is not referenced anywhere else, its contents
+   * are those of its last use.
+   */
+  Ptr acquire()
+  {
+    for (size_t i = 0; i < messages_.size(); ++i)
+    {
+      // only this thread hands out messages, so no one can
+      // take a reference after the check
+      if (messages_[i].unique()) return messages_[i];
+    }
+    messages_.push_back(Ptr(new M));
+    return messages_.back();
+  }
+
+private:
+
+  std::vector<Ptr> messages_;
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef MONO_DEPTH_ODOMETER_H_
+#define MONO_DEPTH_ODOMETER_H_
+
+#include <ros/ros.h>
+#include <sensor_msgs/image_encodings.h>
+#include <image_geometry/stereo_camera_model.h>
+#include <cv_bridge/cv_bridge.h>
+
+#include <fovis_ros/FovisInfo.h>
+
+#include <fovis/depth_image.hpp>
+
+#include "depth_conversion.hpp"
+#include "mono_depth_processor.hpp"
+#include "odometer_base.hpp"
+#include "sparse_depth_image.hpp"
+#include "visualization.hpp"
+
+namespace fovis_ros
+{
+
+class MonoDepthOdometer : public MonoDepthProcessor, protected OdometerBase
+{
+
+private:
+
+  bool sparse_depth_;
+  // region of the depth image that matches the processed image region
+  cv::Rect depth_roi_;
+
+  // dense mode
+  fovis::DepthImage* depth_image_;
+  std::vector<uint8_t> depth_buffer_;
+  DepthConverter depth_converter_;
+
+  // sparse mode
+  SparseDepthImage* sparse_depth_image_;
+
+  // depth image of the current frame
+  DepthPreparation set_depth_image_;
+  sensor_msgs::ImageConstPtr depth_msg_;
+
+public:
+
+  // OdometerBase holds fixed size Eigen members
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  MonoDepthOdometer(const ros::NodeHandle& nh, const ros::NodeHandle& local_nh,
+      const std::string& transport,
+      const SharedResources& shared = SharedResources()) :
+    MonoDepthProcessor(nh, local_nh, transport, shared.thread_pool),
+    OdometerBase(local_nh, shared),
+    depth_image_(NULL),
+    sparse_depth_image_(NULL)
+  {
+    local_nh.param("sparse_depth", sparse_depth_, false);
+    set_depth_image_ = boost::bind(&MonoDepthOdometer::setDepthImage, this);
+    warmStartFromCache(2);
+  }
+
+  ~MonoDepthOdometer()
+  {
+    unsubscribe();
+    stopPipeline();
+    stopPublisher();
+    if (depth_image_) delete depth_image_;
+    if (sparse_depth_image_) delete sparse_depth_image_;
+  }
+
+  /**
+   * Starts publishing and subscribes to the input topics. Call this once
+   * the odometer is constructed, nothing is processed before.
+   */
+  void start()
+  {
+    startPublisher();
+    subscribe();
+  }
+
+protected:
+
+  fovis::DepthSource* createDepthSource(
+      const sensor_msgs::CameraInfoConstPtr& image_info_msg,
+      const sensor_msgs::CameraInfoConstPtr& depth_info_msg)
+  {
+    // read calibration info from camera info message
+    image_geometry::PinholeCameraModel model;
+    model.fromCameraInfo(*image_info_msg);
+    
+    // initialize left camera parameters
+    fovis::CameraIntrinsicsParameters parameters;
+    rosToFovis(model, parameters);
+    adjustToImageRegion(parameters);
+    depth_roi_ = getImageRegion().getRoi(
+        depth_info_msg->width, depth_info_msg->height);
+
+    if (sparse_depth_)
+    {
+      sparse_depth_image_ = new SparseDepthImage(parameters,
+          depth_info_msg->width, depth_info_msg->height, depth_roi_);
+      return sparse_depth_image_;
+    }
+    depth_image_ = new fovis::DepthImage(parameters, 
+        depth_roi_.width, depth_roi_.height);
+    depth_buffer_.reserve(depth_roi_.area() * sizeof(float));
+    return depth_image_;
+  }
+
+  fovis::DepthSource* createDepthSource(const CameraInfos& infos)
+  {
+    if (depth_image_) delete depth_image_;
+    if (sparse_depth_image_) delete sparse_depth_image_;
+    depth_image_ = NULL;
+    sparse_depth_image_ = NULL;
+    return createDepthSource(infos[0], infos[1]);
+  }
+
+  void infoCallback(const sensor_msgs::CameraInfoConstPtr& info_msg, size_t index)
+  {
+    warmStart(info_msg, index, 2);
+  }
+
+  /**
+   * Converts the region of the depth image that is processed if
+   * necessary and passes it to the dense depth source.
+   * \return false if the encoding is not supported
+   */
+  bool setDenseDepthImage(const sensor_msgs::ImageConstPtr& depth_msg)
+  {
+    const float* depth_data;
+    if (depth_msg->encoding == sensor_msgs::image_encodings::TYPE_32FC1)
+    {
+      const cv::Mat depth_image(depth_msg->height, depth_msg->width, CV_32FC1,
+          const_cast<uint8_t*>(&depth_msg->data[0]), depth_msg->step);
+      depth_data = reinterpret_cast<const float*>(
+          getPackedData(depth_image(depth_roi_), depth_buffer_));
+    }
+    else if (depth_msg->encoding == sensor_msgs::image_encodings::TYPE_16UC1)
+    {
+      // millimeters, converted in one pass into the buffer, which
+      // fovis::DepthImage copies into its own storage once more as
+      // that is not accessible, ~sparse_depth avoids both
+      const cv::Mat depth_image(depth_msg->height, depth_msg->width, CV_16UC1,
+          const_cast<uint8_t*>(&depth_msg->data[0]), depth_msg->step);
+      const cv::Mat depth_region(depth_image, depth_roi_);
+      depth_buffer_.resize(depth_region.total() * sizeof(float));
+      float* converted_data = reinterpret_cast<float*>(&depth_buffer_[0]);
+      forEachRowBand(depth_region.rows, boost::bind(
+            &DepthConverter::convertRows, &depth_converter_,
+            boost::cref(depth_region), converted_data, _1, _2));
+      depth_data = converted_data;
+    }
+    else
+    {
+      return false;
+    }
+    depth_image_->setDepthImage(depth_data);
+    return true;
+  }
+
+  void imageCallback(
+      const sensor_msgs::ImageConstPtr& image_msg,
+      const sensor_msgs::ImageConstPtr& depth_msg,
+      const sensor_msgs::CameraInfoConstPtr& image_info_msg,
+      const sensor_msgs::CameraInfoConstPtr& depth_info_msg)
+  {
+    initialize(image_info_msg, depth_info_msg);
+
+    // call base implementation
+    depth_msg_ = depth_msg;
+    if (!process(image_msg, getPipelineStatistics(),
+          set_depth_image_))
+    {
+      ROS_ERROR("Depth image must be in 32bit floating point format (meters) "
+                "or 16bit unsigned integer format (millimeters)!");
+    }
+    depth_msg_.reset();
+  }
+
+  /**
+   * Passes the depth image to the depth source, in sparse mode depth
+   * is only read at the keypoints during processing.
+   */
+  bool setDepthImage()
+  {
+    return sparse_depth_ ? 
+      sparse_depth_image_->setDepthImage(depth_msg_) :
+      setDenseDepthImage(depth_msg_);
+  }
+};
+
+} // end of namespace
+
+#endif
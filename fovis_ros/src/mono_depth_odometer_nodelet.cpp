@@ -0,0 +1,35 @@
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+#include "mono_depth_odometer.hpp"
+
+namespace fovis_ros
+{
+
+/**
+ * Nodelet wrapper for MonoDepthOdometer. Running the odometer in the same
+ * process as the camera driver lets it receive the image and depth frames
+ * by shared pointer instead of serializing them.
+ */
+class MonoDepthOdometerNodelet : public nodelet::Nodelet
+{
+
+private:
+
+  boost::shared_ptr<MonoDepthOdometer> odometer_;
+
+  virtual void onInit()
+  {
+    ros::NodeHandle& nh = getNodeHandle();
+    ros::NodeHandle& local_nh = getPrivateNodeHandle();
+    std::string transport;
+    local_nh.param("transport", transport, std::string("raw"));
+    odometer_.reset(new MonoDepthOdometer(nh, local_nh, transport));
+    odometer_->start();
+  }
+};
+
+} // end of namespace
+
+PLUGINLIB_DECLARE_CLASS(fovis_ros, mono_depth_odometer, fovis_ros::MonoDepthOdometerNodelet, nodelet::Nodelet);
+
@@ -1,5 +1,5 @@
-#ifndef STEREO_PROCESSOR_H_
-#define STEREO_PROCESSOR_H_
+#ifndef MONO_DEPTH_PROCESSOR_H_
+#define MONO_DEPTH_PROCESSOR_H_
 
 #include <ros/ros.h>
 #include <sensor_msgs/Image.h>
@@ -11,6 +11,10 @@
 #include <message_filters/sync_policies/approximate_time.h>
 #include <image_transport/subscriber_filter.h>
 
+#include <boost/scoped_ptr.hpp>
+
+#include "frame_pipeline.hpp"
+
 namespace fovis_ros
 {
 
@@ -27,6 +31,8 @@ class MonoDepthProcessor
 private:
 
   // subscriber
+  ros::NodeHandle nh_;
+  std::string transport_;
   image_transport::SubscriberFilter image_sub_, depth_sub_;
   message_filters::Subscriber<sensor_msgs::CameraInfo> image_info_sub_, depth_info_sub_;
   typedef message_filters::sync_policies::ExactTime<sensor_msgs::Image, sensor_msgs::Image, sensor_msgs::CameraInfo, sensor_msgs::CameraInfo> ExactPolicy;
@@ -37,6 +43,9 @@ private:
   boost::shared_ptr<ApproximateSync> approximate_sync_;
   int queue_size_;
 
+  // optional hand-over of tuples to a worker thread
+  boost::scoped_ptr<FramePipeline<> > pipeline_;
+
   // for sync checking
   ros::WallTimer check_synced_timer_;
   int image_received_, depth_received_, image_info_received_, depth_info_received_, all_received_;
@@ -56,8 +65,11 @@ private:
     // For sync error checking
     ++all_received_; 
 
-    // call implementation
-    imageCallback(image_msg, depth_image_msg, image_info_msg, depth_info_msg);
+    // call implementation directly or through the worker thread
+    if (pipeline_)
+      pipeline_->push(image_msg, depth_image_msg, image_info_msg, depth_info_msg);
+    else
+      imageCallback(image_msg, depth_image_msg, image_info_msg, depth_info_msg);
   }
 
   void checkInputsSynchronized()
@@ -83,43 +95,42 @@ private:
 protected:
 
   /**
-   * Constructor, subscribes to input topics using image transport and registers
-   * callbacks.
+   * Constructor, registers callbacks. Does not subscribe yet, see subscribe().
+   * \param nh The node handle used to resolve and subscribe to topics
+   * \param local_nh The private node handle used to read parameters
    * \param transport The image transport to use
+   * \param thread_pool Shared pool that processes the tuples, if given
    */
-  MonoDepthProcessor(const std::string& transport) :
+  MonoDepthProcessor(const ros::NodeHandle& nh, const ros::NodeHandle& local_nh,
+      const std::string& transport,
+      const boost::shared_ptr<ThreadPool>& thread_pool = boost::shared_ptr<ThreadPool>()) :
+    nh_(nh), transport_(transport),
     image_received_(0), depth_received_(0), image_info_received_(0), depth_info_received_(0), all_received_(0)
   {
-    // Read local parameters
-    ros::NodeHandle local_nh("~");
-
-    // Resolve topic names
-    ros::NodeHandle nh;
-    std::string camera_ns = nh.resolveName("camera");
-    std::string image_topic = ros::names::clean(camera_ns + "/rgb/image_rect");
-    std::string depth_topic = ros::names::clean(camera_ns + "/depth_registered/image_rect");
-
-    std::string image_info_topic = camera_ns + "/rgb/camera_info";
-    std::string depth_info_topic = camera_ns + "/depth_registered/camera_info";
-
-    // Subscribe to four input topics.
-    ROS_INFO("Subscribing to:\n\t* %s\n\t* %s\n\t* %s\n\t* %s", 
-        image_topic.c_str(), depth_topic.c_str(),
-        image_info_topic.c_str(), depth_info_topic.c_str());
-
-    image_transport::ImageTransport it(nh);
-    image_sub_.subscribe(it, image_topic, 1, transport);
-    depth_sub_.subscribe(it, depth_topic, 1, transport);
-    image_info_sub_.subscribe(nh, image_info_topic, 1);
-    depth_info_sub_.subscribe(nh, depth_info_topic, 1);
-
-    // Complain every 15s if the topics appear unsynchronized
+    // Count received messages for sync checking
     image_sub_.registerCallback(boost::bind(MonoDepthProcessor::increment, &image_received_));
     depth_sub_.registerCallback(boost::bind(MonoDepthProcessor::increment, &depth_received_));
     image_info_sub_.registerCallback(boost::bind(MonoDepthProcessor::increment, &image_info_received_));
     depth_info_sub_.registerCallback(boost::bind(MonoDepthProcessor::increment, &depth_info_received_));
-    check_synced_timer_ = nh.createWallTimer(ros::WallDuration(15.0),
-                                             boost::bind(&MonoDepthProcessor::checkInputsSynchronized, this));
+
+    // Camera infos arrive before the first synchronized tuple
+    image_info_sub_.registerCallback(boost::bind(&MonoDepthProcessor::infoCallback, this, _1, 0));
+    depth_info_sub_.registerCallback(boost::bind(&MonoDepthProcessor::infoCallback, this, _1, 1));
+
+    // Optionally process tuples in a dedicated worker thread
+    // or on a pool shared with other odometers
+    bool pipelined;
+    local_nh.param("pipelined", pipelined, false);
+    if (thread_pool)
+    {
+      pipeline_.reset(new FramePipeline<>(
+            boost::bind(&MonoDepthProcessor::imageCallback, this, _1, _2, _3, _4), thread_pool));
+    }
+    else if (pipelined)
+    {
+      pipeline_.reset(new FramePipeline<>(
+            boost::bind(&MonoDepthProcessor::imageCallback, this, _1, _2, _3, _4)));
+    }
 
     // Synchronize input topics. Optionally do approximate synchronization.
     local_nh.param("queue_size", queue_size_, 5);
@@ -139,6 +150,78 @@ protected:
     }
   }
 
+  /**
+   * Subscribes to the input topics. Callbacks may run on other threads
+   * as soon as this returns, so sub-classes must not call this before
+   * they are fully constructed.
+   */
+  void subscribe()
+  {
+    // Resolve topic names
+    std::string camera_ns = nh_.resolveName("camera");
+    std::string image_topic = ros::names::clean(camera_ns + "/rgb/image_rect");
+    std::string depth_topic = ros::names::clean(camera_ns + "/depth_registered/image_rect");
+
+    std::string image_info_topic = camera_ns + "/rgb/camera_info";
+    std::string depth_info_topic = camera_ns + "/depth_registered/camera_info";
+
+    // Subscribe to four input topics.
+    ROS_INFO("Subscribing to:\n\t* %s\n\t* %s\n\t* %s\n\t* %s", 
+        image_topic.c_str(), depth_topic.c_str(),
+        image_info_topic.c_str(), depth_info_topic.c_str());
+
+    image_transport::ImageTransport it(nh_);
+    image_sub_.subscribe(it, image_topic, 1, transport_);
+    depth_sub_.subscribe(it, depth_topic, 1, transport_);
+    image_info_sub_.subscribe(nh_, image_info_topic, 1);
+    depth_info_sub_.subscribe(nh_, depth_info_topic, 1);
+
+    // Complain every 15s if the topics appear unsynchronized
+    check_synced_timer_ = nh_.createWallTimer(ros::WallDuration(15.0),
+                                              boost::bind(&MonoDepthProcessor::checkInputsSynchronized, this));
+  }
+
+  /**
+   * Shuts down the subscribers, callbacks that are running are waited
+   * for. Sub-classes have to call this first in their destructor.
+   */
+  void unsubscribe()
+  {
+    check_synced_timer_.stop();
+    image_sub_.unsubscribe();
+    depth_sub_.unsubscribe();
+    image_info_sub_.unsubscribe();
+    depth_info_sub_.unsubscribe();
+  }
+
+  /**
+   * Stops the worker thread in pipelined mode. Sub-classes have to call
+   * this in their destructor before releasing resources that are used
+   * by imageCallback().
+   */
+  void stopPipeline()
+  {
+    if (pipeline_) pipeline_->stop();
+  }
+
+  /**
+   * Returns hand-over statistics for the tuple that is currently processed.
+   */
+  PipelineStatistics getPipelineStatistics() const
+  {
+    return pipeline_ ? pipeline_->getStatistics() : PipelineStatistics();
+  }
+
+  /**
+   * Called with every camera info message of input index (0 for the
+   * image, 1 for depth), before synchronization. Override this to
+   * prepare for the first tuple.
+   */
+  virtual void infoCallback(const sensor_msgs::CameraInfoConstPtr& /*info_msg*/,
+                            size_t /*index*/)
+  {
+  }
+
   /**
    * Implement this method in sub-classes 
    */
@@ -0,0 +1,115 @@
+#include <ros/ros.h>
+
+#include <boost/thread/thread.hpp>
+
+#include "disparity_odometer.hpp"
+#include "mono_depth_odometer.hpp"
+#include "stereo_odometer.hpp"
+
+/**
+ * Runs one odometer per camera rig in a single process. The rigs share
+ * one tf listener and one thread pool that processes the frames of all
+ * rigs, so a busy rig can use the threads an idle one leaves free.
+ *
+ * Each rig is configured in the private namespace ~<rig>, where
+ * ~<rig>/type selects the odometer (stereo, mono_depth or disparity) and
+ * ~<rig>/stereo, ~<rig>/image and ~<rig>/camera replace the remappings of
+ * the single rig nodes. All other parameters of the odometers are read
+ * from ~<rig> as well and the output topics are advertised there.
+ */
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "multi_odometer");
+  ros::NodeHandle local_nh("~");
+
+  XmlRpc::XmlRpcValue rigs;
+  if (!local_nh.getParam("rigs", rigs) ||
+      rigs.getType() != XmlRpc::XmlRpcValue::TypeArray || rigs.size() == 0)
+  {
+    ROS_FATAL("~rigs has to be a non-empty list of rig names! Example:\n"
+              "\trigs: [front, rear]\n"
+              "\tfront: {type: stereo, stereo: /front_stereo, image: image_rect}");
+    return 1;
+  }
+
+  int num_threads;
+  local_nh.param("num_threads", num_threads, 0);
+  if (num_threads <= 0)
+  {
+    num_threads = std::max(1u, boost::thread::hardware_concurrency());
+  }
+
+  fovis_ros::SharedResources shared;
+  shared.tf_listener.reset(new tf::TransformListener());
+  shared.thread_pool.reset(new fovis_ros::ThreadPool(num_threads));
+  ROS_INFO("Processing %d rig(s) with %d thread(s).", rigs.size(), num_threads);
+
+  std::vector<boost::shared_ptr<fovis_ros::StereoOdometer> > stereo_odometers;
+  std::vector<boost::shared_ptr<fovis_ros::MonoDepthOdometer> > mono_depth_odometers;
+  std::vector<boost::shared_ptr<fovis_ros::DisparityOdometer> > disparity_odometers;
+  for (int i = 0; i < rigs.size(); ++i)
+  {
+    if (rigs[i].getType() != XmlRpc::XmlRpcValue::TypeString)
+    {
+      ROS_FATAL("Entry %d of ~rigs is not a rig name, ~rigs has to be a "
+                "list of strings.", i);
+      return 1;
+    }
+    std::string rig = static_cast<std::string&>(rigs[i]);
+    ros::NodeHandle rig_nh(local_nh, rig);
+
+    std::string type, transport;
+    rig_nh.param("type", type, std::string("stereo"));
+    rig_nh.param("transport", transport, std::string("raw"));
+
+    // topic names that would be remapped on the command line
+    // for a single rig node
+    ros::M_string remappings;
+    const char* names[] = { "stereo", "image", "camera" };
+    for (size_t j = 0; j < sizeof(names) / sizeof(names[0]); ++j)
+    {
+      std::string topic;
+      if (rig_nh.getParam(names[j], topic))
+      {
+        remappings[names[j]] = topic;
+      }
+    }
+    ros::NodeHandle nh("", remappings);
+
+    ROS_INFO("Starting %s odometer for rig '%s'.", type.c_str(), rig.c_str());
+    if (type == "stereo")
+    {
+      stereo_odometers.push_back(boost::shared_ptr<fovis_ros::StereoOdometer>(
+            new fovis_ros::StereoOdometer(nh, rig_nh, transport, shared)));
+      stereo_odometers.back()->start();
+    }
+    else if (type == "mono_depth")
+    {
+      mono_depth_odometers.push_back(boost::shared_ptr<fovis_ros::MonoDepthOdometer>(
+            new fovis_ros::MonoDepthOdometer(nh, rig_nh, transport, shared)));
+      mono_depth_odometers.back()->start();
+    }
+    else if (type == "disparity")
+    {
+      disparity_odometers.push_back(boost::shared_ptr<fovis_ros::DisparityOdometer>(
+            new fovis_ros::DisparityOdometer(nh, rig_nh, transport, shared)));
+      disparity_odometers.back()->start();
+    }
+    else
+    {
+      ROS_FATAL("Unknown type '%s' of rig '%s', must be one of "
+                "stereo, mono_depth or disparity.", type.c_str(), rig.c_str());
+      return 1;
+    }
+  }
+
+  // the callbacks only synchronize and hand the tuples to the pool
+  ros::spin();
+
+  // stop all odometers before the pool they share goes away
+  stereo_odometers.clear();
+  mono_depth_odometers.clear();
+  disparity_odometers.clear();
+  return 0;
+}
+
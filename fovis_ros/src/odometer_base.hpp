@@ -1,3 +1,11 @@
+#ifndef ODOMETER_BASE_H_
+#define ODOMETER_BASE_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
 #include <ros/ros.h>
 #include <sensor_msgs/image_encodings.h>
 #include <image_geometry/pinhole_camera_model.h>
@@ -13,6 +21,25 @@
 #include <tf/transform_listener.h>
 #include <tf/transform_broadcaster.h>
 
+#include <boost/bind.hpp>
+#include <boost/detail/atomic_count.hpp>
+#include <boost/function.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "bounded_queue.hpp"
+#include "calibration_cache.hpp"
+#include "feature_painter.hpp"
+#include "frame_pipeline.hpp"
+#include "image_region.hpp"
+#include "message_pool.hpp"
+#include "shared_resources.hpp"
+#include "stage_timer.hpp"
+#include "thread_pool.hpp"
+#include "timed_depth_source.hpp"
+#include "trace_recorder.hpp"
 #include "visualization.hpp"
 
 namespace fovis_ros
@@ -26,27 +53,104 @@ class OdometerBase
 
 protected:
 
-  OdometerBase() : 
+  /**
+   * Constructor, reads parameters and advertises output topics.
+   * \param local_nh The private node handle to read parameters from and
+   *                 to advertise topics on
+   * \param shared Resources shared with other odometers in the process
+   */
+  OdometerBase(const ros::NodeHandle& local_nh,
+      const SharedResources& shared = SharedResources()) : 
     visual_odometer_(NULL),
     rectification_(NULL),
     depth_source_(NULL),
     visual_odometer_options_(fovis::VisualOdometry::getDefaultOptions()),
-    nh_local_("~"),
-    it_(nh_local_)
+    has_reference_frame_(false),
+    calibration_confirmed_(false),
+    num_image_conversions_(0),
+    num_image_copies_(0),
+    current_image_msg_(NULL),
+    current_prepare_depth_(NULL),
+    image_data_(NULL),
+    depth_ok_(false),
+    thread_pool_(shared.thread_pool),
+    average_processing_time_(0.0),
+    frame_skip_(0),
+    num_skipped_frames_(0),
+    has_initial_base_to_sensor_(false),
+    tf_listener_(shared.tf_listener),
+    nh_local_(local_nh),
+    it_(nh_local_),
+    odom_msgs_(2),
+    pose_msgs_(2),
+    info_msgs_(RESULT_QUEUE_SIZE + 2),
+    info_required_(false),
+    result_queue_(RESULT_QUEUE_SIZE)
   {
     loadParams();
+    if (!tf_listener_)
+    {
+      tf_listener_.reset(new tf::TransformListener());
+    }
+    pose_correction_.setIdentity();
+    pose_covariance_.setZero();
+    reference_pose_covariance_.setZero();
+    initial_base_to_sensor_.setIdentity();
+    base_to_sensor_.setIdentity();
+    sensor_to_base_.setIdentity();
+    preparation_task_ = boost::bind(&OdometerBase::prepare, this, _1);
+    // one result per queue slot plus the ones being filled and published
+    for (size_t i = 0; i < RESULT_QUEUE_SIZE + 2; ++i)
+    {
+      results_.push_back(boost::shared_ptr<OdometryResult>(new OdometryResult));
+    }
     odom_pub_ = nh_local_.advertise<nav_msgs::Odometry>("odometry", 1);
     pose_pub_ = nh_local_.advertise<geometry_msgs::PoseStamped>("pose", 1);
     info_pub_ = nh_local_.advertise<FovisInfo>("info", 1);
     features_pub_ = it_.advertise("features", 1);
+    feature_painter_.reset(new FeaturePainter(features_pub_));
+    if (!trace_file_.empty())
+    {
+      if (trace_recorder_.open(trace_file_, std::max(trace_capacity_, 0)))
+        ROS_INFO("Recording the last %d frames to '%s'.",
+            trace_capacity_, trace_file_.c_str());
+      else
+        ROS_ERROR("Cannot open trace file '%s': %s", trace_file_.c_str(),
+            trace_recorder_.getError().c_str());
+    }
   }
 
   virtual ~OdometerBase()
   {
+    stopPublisher();
     if (visual_odometer_) delete visual_odometer_;
     if (rectification_) delete rectification_;
   }
 
+  /**
+   * Starts the publisher thread in pipelined mode. The thread calls
+   * onInfo(), so sub-classes must not call this before they are fully
+   * constructed.
+   */
+  void startPublisher()
+  {
+    if (pipelined_ && !publisher_thread_.joinable())
+    {
+      publisher_thread_ = boost::thread(
+          boost::bind(&OdometerBase::runPublisher, this));
+    }
+  }
+
+  /**
+   * Stops the publisher thread. Sub-classes have to call this in their
+   * destructor, next to stopPipeline().
+   */
+  void stopPublisher()
+  {
+    result_queue_.shutdown();
+    if (publisher_thread_.joinable()) publisher_thread_.join();
+  }
+
   const fovis::VisualOdometryOptions& getOptions() const
   {
     return visual_odometer_options_;
@@ -54,12 +158,91 @@ protected:
 
   /**
    * Sets the depth source, must be called once before calling process()
+   * if createDepthSource() cannot create it from the camera infos.
    */
   void setDepthSource(fovis::DepthSource* source)
   {
     depth_source_ = source;
   }
 
+  typedef calibration_cache::CameraInfos CameraInfos;
+
+  /**
+   * Creates the depth source for the given camera infos and releases a
+   * previous one. Called with the lock of initialize() held, possibly
+   * before the first frame from the camera info callbacks or from
+   * ~calibration_file.
+   * \return NULL if the depth source can only be created from the first
+   *         frame, it has to be passed to setDepthSource() then
+   */
+  virtual fovis::DepthSource* createDepthSource(const CameraInfos& infos) = 0;
+
+  /**
+   * Builds odometer and depth source from the camera infos of an input
+   * tuple, to be called by implementing classes before process(). Only
+   * the first tuple is checked against a warm start, later calibration
+   * changes are ignored as before.
+   */
+  void initialize(const sensor_msgs::CameraInfoConstPtr& info_msg,
+      const sensor_msgs::CameraInfoConstPtr& second_info_msg =
+        sensor_msgs::CameraInfoConstPtr())
+  {
+    boost::mutex::scoped_lock lock(init_mutex_);
+    if (calibration_confirmed_) return;
+    CameraInfos infos(1, info_msg);
+    if (second_info_msg) infos.push_back(second_info_msg);
+    initializeLocked(infos);
+  }
+
+  /**
+   * Builds odometer and depth source as soon as the camera infos of all
+   * inputs have been received once, so the first tuple does not have to
+   * wait for it. To be called from the camera info callbacks.
+   * \param index Index of the input the info belongs to
+   * \param num_infos Number of camera infos of the odometer
+   */
+  void warmStart(const sensor_msgs::CameraInfoConstPtr& info_msg,
+      size_t index, size_t num_infos)
+  {
+    boost::mutex::scoped_lock lock(init_mutex_);
+    if (calibration_confirmed_) return;
+    pending_infos_.resize(num_infos);
+    pending_infos_[index] = info_msg;
+    for (size_t i = 0; i < num_infos; ++i)
+    {
+      if (!pending_infos_[i]) return;
+    }
+    initializeLocked(pending_infos_);
+    pending_infos_.clear();
+  }
+
+  /**
+   * Builds odometer and depth source from ~calibration_file if it holds
+   * num_infos camera infos, to be called at the end of the constructor of
+   * implementing classes. The first received camera infos are checked
+   * against it.
+   */
+  void warmStartFromCache(size_t num_infos)
+  {
+    if (calibration_file_.empty()) return;
+    boost::mutex::scoped_lock lock(init_mutex_);
+    CameraInfos infos;
+    if (!calibration_cache::load(calibration_file_, infos))
+    {
+      ROS_INFO("No calibration cached in '%s' yet.", calibration_file_.c_str());
+      return;
+    }
+    if (infos.size() != num_infos)
+    {
+      ROS_WARN("Calibration file '%s' holds %d camera infos, expected %d, "
+               "ignoring it.", calibration_file_.c_str(),
+               static_cast<int>(infos.size()), static_cast<int>(num_infos));
+      return;
+    }
+    ROS_INFO("Initializing from calibration file '%s'.", calibration_file_.c_str());
+    buildOdometer(infos);
+  }
+
   static void rosToFovis(const image_geometry::PinholeCameraModel& camera_model,
       fovis::CameraIntrinsicsParameters& parameters)
   {
@@ -72,131 +255,325 @@ protected:
   }
 
   /**
-   * To be called by implementing classes after the depth source has
-   * been fed with data.
+   * Adjusts the intrinsics of the full input image to the configured
+   * region of interest and downscale factor.
+   */
+  void adjustToImageRegion(fovis::CameraIntrinsicsParameters& parameters)
+  {
+    image_region_.adjust(parameters);
+  }
+
+  /**
+   * The region of the input images that is processed, valid after the
+   * first call to adjustToImageRegion().
+   */
+  const ImageRegion& getImageRegion() const
+  {
+    return image_region_;
+  }
+
+  /**
+   * Returns the processed region of the image as packed MONO8. Images
+   * that already have that encoding are read from the message directly,
+   * others are converted into cv_ptr, which has to be kept alive while
+   * the data is used. Padded rows, cropped columns and downscaling
+   * use buffer.
+   */
+  const uint8_t* getMono8Data(const sensor_msgs::ImageConstPtr& image_msg,
+      cv_bridge::CvImageConstPtr& cv_ptr, std::vector<uint8_t>& buffer)
+  {
+    if (image_msg->encoding == sensor_msgs::image_encodings::MONO8)
+    {
+      const cv::Mat image(image_msg->height, image_msg->width, CV_8UC1,
+          const_cast<uint8_t*>(&image_msg->data[0]), image_msg->step);
+      return getRegionData(image, buffer);
+    }
+    ++num_image_conversions_;
+    cv_ptr = cv_bridge::toCvShare(image_msg, sensor_msgs::image_encodings::MONO8);
+    return getRegionData(cv_ptr->image, buffer);
+  }
+
+  /**
+   * Returns the processed region of the MONO8 image without row padding.
+   */
+  const uint8_t* getRegionData(const cv::Mat& image, std::vector<uint8_t>& buffer)
+  {
+    const cv::Mat region(image, image_region_.getRoi());
+    int downscale = image_region_.getDownscale();
+    if (downscale == 1)
+      return getPackedData(region, buffer);
+
+    buffer.resize((region.cols / downscale) * (region.rows / downscale));
+    cv::Mat scaled(region.rows / downscale, region.cols / downscale,
+        CV_8UC1, &buffer[0]);
+    cv::resize(region, scaled, scaled.size(), 0, 0, cv::INTER_AREA);
+    return &buffer[0];
+  }
+
+  /**
+   * Returns the image data without row padding as fovis expects it.
+   * Images with padded rows are copied into buffer.
+   */
+  const uint8_t* getPackedData(const cv::Mat& image, std::vector<uint8_t>& buffer)
+  {
+    size_t row_size = image.cols * image.elemSize();
+    if (image.step[0] == row_size)
+      return image.data;
+
+    ++num_image_copies_;
+    buffer.resize(row_size * image.rows);
+    forEachRowBand(image.rows, boost::bind(&OdometerBase::copyRows,
+          boost::cref(image), &buffer[0], _1, _2));
+    return &buffer[0];
+  }
+
+  /**
+   * Calls function(begin_row, end_row) for horizontal bands that cover
+   * rows [0, num_rows), concurrently on the thread pool if there is one.
+   * The bands do not overlap, so functions that only write their own rows
+   * produce the same result as a single call for all rows.
+   */
+  template <typename RowBandFunction>
+  void forEachRowBand(int num_rows, const RowBandFunction& function)
+  {
+    int num_bands = thread_pool_ ? thread_pool_->getNumThreads() + 1 : 1;
+    num_bands = std::min(num_bands, num_rows / MIN_BAND_ROWS);
+    if (num_bands <= 1)
+    {
+      function(0, num_rows);
+      return;
+    }
+    thread_pool_->run(num_bands, boost::bind(
+          &OdometerBase::runRowBand<RowBandFunction>,
+          boost::cref(function), num_rows, num_bands, _1));
+  }
+
+  /**
+   * Feeds the depth source with the data of the current frame.
+   * Implementing classes should create it once, creating a new function
+   * object for every frame allocates memory.
+   * \return false if the data cannot be used, the frame is skipped then
+   */
+  typedef boost::function<bool ()> DepthPreparation;
+
+  /**
+   * Called with the info message of every processed frame after it has
+   * been published. Override this to collect statistics, the info is
+   * only filled for every frame after setInfoRequired(true), otherwise
+   * only while ~info has subscribers.
+   */
+  virtual void onInfo(const FovisInfo& /*fovis_info_msg*/)
+  {
+  }
+
+  void setInfoRequired(bool info_required)
+  {
+    info_required_ = info_required;
+  }
+
+  /**
+   * Overrides ~pipelined, to be called before startPublisher(). Without
+   * pipelining, process() publishes the result before it returns.
+   */
+  void setPipelined(bool pipelined)
+  {
+    pipelined_ = pipelined;
+  }
+
+  /**
+   * To be called by implementing classes for every input tuple.
+   * \param pipeline_stats Hand-over statistics of the processor
+   * \param prepare_depth Feeds the depth source, runs concurrently to the
+   *        conversion of the image if ~num_threads is greater than 1
+   * \return false if the depth preparation failed
    */
-  void process(
+  bool process(
       const sensor_msgs::ImageConstPtr& image_msg, 
-      const sensor_msgs::CameraInfoConstPtr& info_msg)
+      const PipelineStatistics& pipeline_stats,
+      const DepthPreparation& prepare_depth)
   {
     ros::WallTime start_time = ros::WallTime::now();
 
-    bool first_run = false;
-    if (visual_odometer_ == NULL)
+    bool first_run = !has_reference_frame_;
+    if (!first_run && isFrameSkipped())
     {
-      first_run = true;
-      initOdometer(info_msg);
+      // the next frame is matched against the last processed one
+      return true;
     }
     ROS_ASSERT(visual_odometer_ != NULL);
     ROS_ASSERT(depth_source_ != NULL);
 
-    // convert image if necessary
-    uint8_t *image_data;
-    cv_bridge::CvImageConstPtr cv_ptr = 
-      cv_bridge::toCvShare(image_msg, sensor_msgs::image_encodings::MONO8);
-    image_data = cv_ptr->image.data;
-    int step = cv_ptr->image.step[0];
-
-    ROS_ASSERT(step == static_cast<int>(image_msg->width));
+    // convert image if necessary and feed the depth source
+    current_image_msg_ = &image_msg;
+    current_prepare_depth_ = &prepare_depth;
+    if (thread_pool_)
+    {
+      thread_pool_->run(NUM_PREPARATION_TASKS, preparation_task_);
+    }
+    else
+    {
+      for (size_t i = 0; i < NUM_PREPARATION_TASKS; ++i) preparation_task_(i);
+    }
+    if (!depth_ok_)
+    {
+      cv_ptr_.reset();
+      stage_times_ = StageTimes();
+      return false;
+    }
 
     // pass image to odometer
-    visual_odometer_->processFrame(image_data, depth_source_);
+#ifndef FOVIS_ROS_DISABLE_STAGE_TIMING
+    timed_depth_source_.start(depth_source_);
+    visual_odometer_->processFrame(image_data_, &timed_depth_source_);
+    timed_depth_source_.stop(stage_times_);
+#else
+    visual_odometer_->processFrame(image_data_, depth_source_);
+#endif
+    cv_ptr_.reset();
+    has_reference_frame_ = true;
 
     // skip visualization on first run as no reference image is present
-    if (!first_run && features_pub_.getNumSubscribers() > 0)
+    // and limit the rate of painting as it happens in the background
+    if (!first_run && features_pub_.getNumSubscribers() > 0 &&
+        isFeaturesImageDue(image_msg->header.stamp))
     {
-      cv_bridge::CvImage cv_image;
-      cv_image.header.stamp = image_msg->header.stamp;
-      cv_image.header.frame_id = image_msg->header.frame_id;
-      cv_image.encoding = sensor_msgs::image_encodings::BGR8;
-      cv_image.image = visualization::paint(visual_odometer_);
-      features_pub_.publish(cv_image.toImageMsg());
+      ScopedStageTimer timer(stage_times_.visualization);
+      FeaturePainter::SnapshotPtr snapshot = feature_painter_->acquireSnapshot();
+      visualization::takeSnapshot(visual_odometer_, *snapshot);
+      feature_painter_->push(image_msg, reference_image_msg_,
+          image_region_, snapshot);
+      last_features_time_ = image_msg->header.stamp;
+    }
+    // fovis matches the next frames against this one
+    if (visual_odometer_->getChangeReferenceFrames())
+    {
+      reference_image_msg_ = image_msg;
     }
 
-    // create odometry and pose messages
-    nav_msgs::Odometry odom_msg;
-    odom_msg.header.stamp = image_msg->header.stamp;
-    odom_msg.header.frame_id = odom_frame_id_;
-    odom_msg.child_frame_id = base_link_frame_id_;
-    geometry_msgs::PoseStamped pose_msg;
-    pose_msg.header.stamp = image_msg->header.stamp;
-    pose_msg.header.frame_id = base_link_frame_id_;
-
-    // on success, start fill message and tf
-    fovis::MotionEstimateStatusCode status = 
-      visual_odometer_->getMotionEstimateStatus();
-    if (status == fovis::SUCCESS)
-    {
-      // get pose and motion from odometer
-      const Eigen::Isometry3d& pose = visual_odometer_->getPose();
-      tf::Transform sensor_pose;
-      eigenToTF(pose, sensor_pose);
-      // calculate transform of odom to base based on base to sensor 
-      // and sensor to sensor
-      tf::StampedTransform current_base_to_sensor;
-      getBaseToSensorTransform(
-          image_msg->header.stamp, image_msg->header.frame_id, 
-          current_base_to_sensor);
-      tf::Transform base_transform = 
-        initial_base_to_sensor_ * sensor_pose * current_base_to_sensor.inverse();
+    // copy everything needed for publishing, the odometer
+    // state is overwritten by the next frame
+    OdometryResultPtr result = acquireResult();
+    result->header = image_msg->header;
+    result->status = visual_odometer_->getMotionEstimateStatus();
+    result->pose = visual_odometer_->getPose();
+    result->motion = visual_odometer_->getMotionEstimate();
+    result->motion_cov = visual_odometer_->getMotionEstimateCov();
+    result->change_reference_frame = visual_odometer_->getChangeReferenceFrames();
+    double processing_time = (ros::WallTime::now() - start_time).toSec();
+    result->info.reset();
+    if (info_required_ || trace_recorder_.isOpen() ||
+        info_pub_.getNumSubscribers() > 0)
+    {
+      result->info = info_msgs_.acquire();
+      FovisInfo& info = *result->info;
+      fillInfo(info);
+      info.header.stamp = image_msg->header.stamp;
+      info.queue_wait_time = pipeline_stats.queue_wait_time;
+      info.num_dropped_tuples = pipeline_stats.num_dropped_tuples;
+      fillStageTimes(info);
+    }
+    updateFrameSkip(processing_time, result->info.get());
+    stage_times_ = StageTimes();
+    // measured before the hand-over, in pipelined mode the result may
+    // wait in the queue and is published by another thread
+    if (result->info)
+    {
+      result->info->runtime = (ros::WallTime::now() - start_time).toSec();
+    }
 
-      // publish transform
-      if (publish_tf_)
+    if (pipelined_)
+    {
+      if (result_queue_.push(result))
       {
-        tf_broadcaster_.sendTransform(
-            tf::StampedTransform(base_transform, image_msg->header.stamp,
-            odom_frame_id_, base_link_frame_id_));
+        ROS_WARN_THROTTLE(10.0, "Publisher thread cannot keep up, "
+            "dropping odometry results.");
       }
+    }
+    else
+    {
+      publish(*result);
+    }
+    return true;
+  }
 
-      // fill odometry and pose msg
-      tf::poseTFToMsg(base_transform, odom_msg.pose.pose);
-      pose_msg.pose = odom_msg.pose.pose;
 
-      // can we calculate velocities?
-      double dt = last_time_.isZero() ? 
-        0.0 : (image_msg->header.stamp - last_time_).toSec();
-      if (dt > 0.0)
-      {
-        const Eigen::Isometry3d& motion = visual_odometer_->getMotionEstimate();
-        tf::Transform sensor_motion;
-        eigenToTF(motion, sensor_motion);
-        // in theory the first factor would have to be base_to_sensor of t-1
-        // and not of t (irrelevant for static base to sensor anyways)
-        tf::Transform delta_base_transform = 
-          current_base_to_sensor * sensor_motion * current_base_to_sensor.inverse();
-        // calculate twist from delta transform
-        odom_msg.twist.twist.linear.x = delta_base_transform.getOrigin().getX() / dt;
-        odom_msg.twist.twist.linear.y = delta_base_transform.getOrigin().getY() / dt;
-        odom_msg.twist.twist.linear.z = delta_base_transform.getOrigin().getZ() / dt;
-        tf::Quaternion delta_rot = delta_base_transform.getRotation();
-        double angle = delta_rot.getAngle();
-        tf::Vector3 axis = delta_rot.getAxis();
-        tf::Vector3 angular_twist = axis * angle / dt;
-        odom_msg.twist.twist.angular.x = angular_twist.x();
-        odom_msg.twist.twist.angular.y = angular_twist.y();
-        odom_msg.twist.twist.angular.z = angular_twist.z();
+private:
 
-        // add covariance
-        const Eigen::MatrixXd& motion_cov = visual_odometer_->getMotionEstimateCov();
-        for (int i=0;i<6;i++)
-          for (int j=0;j<6;j++)
-            odom_msg.twist.covariance[j*6+i] = motion_cov(i,j);
-      }
-      // TODO integrate covariance for pose covariance
-      last_time_ = image_msg->header.stamp;
+  /**
+   * Everything that is needed to publish the result of one frame.
+   */
+  struct OdometryResult
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    std_msgs::Header header;
+    fovis::MotionEstimateStatusCode status;
+    Eigen::Isometry3d pose;
+    Eigen::Isometry3d motion;
+    Eigen::Matrix<double, 6, 6> motion_cov;
+    bool change_reference_frame;
+    /// empty if nobody needs the info of this frame
+    FovisInfoPtr info;
+  };
+  typedef boost::shared_ptr<OdometryResult> OdometryResultPtr;
+
+  /**
+   * Returns a result that is neither queued nor being published,
+   * results are reused to avoid allocations.
+   */
+  OdometryResultPtr acquireResult()
+  {
+    for (size_t i = 0; i < results_.size(); ++i)
+    {
+      // only this thread hands out results, so no one can
+      // take a reference after the check
+      if (results_[i].unique()) return results_[i];
+    }
+    results_.push_back(OdometryResultPtr(new OdometryResult));
+    return results_.back();
+  }
+
+  /**
+   * Runs one of the tasks that prepare the current frame for processing.
+   */
+  void prepare(size_t task)
+  {
+    if (task == 0)
+    {
+      ScopedStageTimer timer(stage_times_.image_conversion);
+      image_data_ = getMono8Data(*current_image_msg_, cv_ptr_, image_buffer_);
     }
     else
     {
-      ROS_ERROR_STREAM("fovis odometry failed: " << 
-          fovis::MotionEstimateStatusCodeStrings[status]);
-      last_time_ = ros::Time(0);
+      ScopedStageTimer timer(stage_times_.depth_preparation);
+      depth_ok_ = (*current_prepare_depth_)();
     }
-    odom_pub_.publish(odom_msg);
-    pose_pub_.publish(pose_msg);
+  }
+
+  template <typename RowBandFunction>
+  static void runRowBand(const RowBandFunction& function,
+      int num_rows, int num_bands, size_t band)
+  {
+    int band_index = static_cast<int>(band);
+    function(num_rows * band_index / num_bands,
+        num_rows * (band_index + 1) / num_bands);
+  }
+
+  static void copyRows(const cv::Mat& image, uint8_t* output,
+      int begin_row, int end_row)
+  {
+    size_t row_size = image.cols * image.elemSize();
+    for (int row = begin_row; row < end_row; ++row)
+    {
+      memcpy(output + row * row_size, image.ptr(row), row_size);
+    }
+  }
 
-    // create and publish fovis info msg
-    FovisInfo fovis_info_msg;
-    fovis_info_msg.header.stamp = image_msg->header.stamp;
+  /**
+   * Fills the fovis internals of the current frame into the info message.
+   */
+  void fillInfo(FovisInfo& fovis_info_msg) const
+  {
     fovis_info_msg.change_reference_frame = 
       visual_odometer_->getChangeReferenceFrames();
     fovis_info_msg.fast_threshold =
@@ -228,13 +605,451 @@ protected:
       estimator->getNumReprojectionFailures();
     fovis_info_msg.motion_estimate_valid = 
       estimator->isMotionEstimateValid();
-    ros::WallDuration time_elapsed = ros::WallTime::now() - start_time;
-    fovis_info_msg.runtime = time_elapsed.toSec();
-    info_pub_.publish(fovis_info_msg);
+    fovis_info_msg.num_image_conversions = num_image_conversions_;
+    fovis_info_msg.num_image_copies = num_image_copies_;
   }
 
+  void fillStageTimes(FovisInfo& fovis_info_msg) const
+  {
+    fovis_info_msg.image_conversion_time = stage_times_.image_conversion;
+    fovis_info_msg.depth_preparation_time = stage_times_.depth_preparation;
+    fovis_info_msg.feature_detection_time = stage_times_.feature_detection;
+    fovis_info_msg.depth_time = stage_times_.depth;
+    fovis_info_msg.matching_time = stage_times_.matching;
+    fovis_info_msg.depth_refinement_time = stage_times_.depth_refinement;
+    fovis_info_msg.motion_estimation_time = stage_times_.motion_estimation;
+    fovis_info_msg.visualization_time = stage_times_.visualization;
+  }
 
-private:
+  /**
+   * Creates and publishes odometry, pose, tf and info for one frame.
+   * Odometry and pose messages are only filled if they have subscribers
+   * or are needed for the trace, tf is always sent.
+   */
+  void publish(OdometryResult& result)
+  {
+    const std_msgs::Header& image_header = result.header;
+
+    // create odometry and pose messages, reused from earlier frames
+    nav_msgs::OdometryPtr odom_msg;
+    if (odom_pub_.getNumSubscribers() > 0 || trace_recorder_.isOpen())
+    {
+      odom_msg = odom_msgs_.acquire();
+      odom_msg->header.stamp = image_header.stamp;
+      odom_msg->header.frame_id = odom_frame_id_;
+      odom_msg->child_frame_id = base_link_frame_id_;
+      odom_msg->pose = geometry_msgs::PoseWithCovariance();
+      odom_msg->twist = geometry_msgs::TwistWithCovariance();
+    }
+    geometry_msgs::PoseStampedPtr pose_msg;
+    if (pose_pub_.getNumSubscribers() > 0)
+    {
+      pose_msg = pose_msgs_.acquire();
+      pose_msg->header.stamp = image_header.stamp;
+      pose_msg->header.frame_id = base_link_frame_id_;
+      pose_msg->pose = geometry_msgs::Pose();
+    }
+
+    double tf_lookup_time = 0.0;
+
+    // store initial transform for later usage, looked up with the first
+    // frame as the odometer may have been built from cached camera infos
+    if (!has_initial_base_to_sensor_)
+    {
+      ScopedStageTimer timer(tf_lookup_time);
+      updateBaseToSensorTransform(image_header.stamp, image_header.frame_id);
+      initial_base_to_sensor_ = base_to_sensor_;
+      has_initial_base_to_sensor_ = true;
+    }
+
+    // fovis does not move the pose on failure, fill in the
+    // motion of the failed frame from the prior if there is one
+    bool motion_prior_used = false;
+    if (result.status != fovis::SUCCESS && !motion_prior_frame_id_.empty())
+    {
+      ScopedStageTimer timer(tf_lookup_time);
+      motion_prior_used = applyMotionPrior(result.pose, image_header);
+    }
+
+    // on success, start fill message and tf
+    if (result.status == fovis::SUCCESS || motion_prior_used)
+    {
+      // calculate transform of odom to base based on base to sensor 
+      // and sensor to sensor, composed in Eigen and converted once
+      {
+        ScopedStageTimer timer(tf_lookup_time);
+        updateBaseToSensorTransform(image_header.stamp, image_header.frame_id);
+      }
+      Eigen::Isometry3d sensor_pose =
+        initial_base_to_sensor_ * pose_correction_ * result.pose;
+      Eigen::Isometry3d base_pose = sensor_pose * sensor_to_base_;
+      tf::Transform base_transform;
+      eigenToTF(base_pose, base_transform);
+
+      // publish transform
+      if (publish_tf_)
+      {
+        tf_broadcaster_.sendTransform(
+            tf::StampedTransform(base_transform, image_header.stamp,
+            odom_frame_id_, base_link_frame_id_));
+      }
+
+      // frames bridged by the motion prior add no uncertainty,
+      // as the prior does not come with a covariance
+      if (result.status == fovis::SUCCESS)
+      {
+        updatePoseCovariance(sensor_pose, result.motion_cov);
+      }
+
+      // fill pose msg
+      if (pose_msg)
+      {
+        tf::poseTFToMsg(base_transform, pose_msg->pose);
+      }
+
+      // fill odometry msg
+      double dt = last_time_.isZero() ? 
+        0.0 : (image_header.stamp - last_time_).toSec();
+      if (odom_msg)
+      {
+        tf::poseTFToMsg(base_transform, odom_msg->pose.pose);
+        fillPoseCovariance(base_pose, odom_msg->pose.covariance.data());
+      }
+      // can we calculate velocities?
+      if (odom_msg && dt > 0.0 && result.status == fovis::SUCCESS)
+      {
+        // in theory the first factor would have to be base_to_sensor of t-1
+        // and not of t (irrelevant for static base to sensor anyways)
+        Eigen::Isometry3d delta_base_transform =
+          base_to_sensor_ * result.motion * sensor_to_base_;
+        // calculate twist from delta transform
+        Eigen::Vector3d linear_twist = delta_base_transform.translation() / dt;
+        odom_msg->twist.twist.linear.x = linear_twist.x();
+        odom_msg->twist.twist.linear.y = linear_twist.y();
+        odom_msg->twist.twist.linear.z = linear_twist.z();
+        Eigen::AngleAxisd delta_rot(delta_base_transform.rotation());
+        Eigen::Vector3d angular_twist = delta_rot.axis() * delta_rot.angle() / dt;
+        odom_msg->twist.twist.angular.x = angular_twist.x();
+        odom_msg->twist.twist.angular.y = angular_twist.y();
+        odom_msg->twist.twist.angular.z = angular_twist.z();
+
+        // add covariance
+        Covariance::Map(odom_msg->twist.covariance.data()) = result.motion_cov;
+      }
+      last_time_ = image_header.stamp;
+      if (motion_prior_used)
+      {
+        ROS_WARN_STREAM("fovis odometry failed: " << 
+            fovis::MotionEstimateStatusCodeStrings[result.status] <<
+            ", using motion prior from " << motion_prior_frame_id_);
+      }
+    }
+    else
+    {
+      ROS_ERROR_STREAM("fovis odometry failed: " << 
+          fovis::MotionEstimateStatusCodeStrings[result.status]);
+      last_time_ = ros::Time(0);
+    }
+    last_frame_time_ = image_header.stamp;
+    // the following motions are estimated against this frame
+    if (result.change_reference_frame)
+    {
+      reference_pose_covariance_ = pose_covariance_;
+    }
+    if (odom_msg && odom_pub_.getNumSubscribers() > 0)
+    {
+      odom_pub_.publish(odom_msg);
+    }
+    if (pose_msg)
+    {
+      pose_pub_.publish(pose_msg);
+    }
+
+    // publish fovis info msg, only filled if someone needs it
+    if (!result.info) return;
+    FovisInfo& fovis_info_msg = *result.info;
+    fovis_info_msg.tf_lookup_time = tf_lookup_time;
+    fovis_info_msg.motion_prior_used = motion_prior_used;
+    if (trace_recorder_.isOpen())
+    {
+      recordTrace(*odom_msg, fovis_info_msg);
+    }
+    if (info_pub_.getNumSubscribers() > 0)
+    {
+      info_pub_.publish(result.info);
+    }
+    onInfo(fovis_info_msg);
+    // the result keeps no reference, the message goes back to the pool
+    // once subscribers are done with it
+    result.info.reset();
+  }
+
+  /**
+   * Writes the published odometry and info of one frame to the trace.
+   */
+  void recordTrace(const nav_msgs::Odometry& odom_msg, const FovisInfo& info)
+  {
+    TraceRecord& record = trace_recorder_.next();
+    record.stamp = odom_msg.header.stamp.toSec();
+    const geometry_msgs::Pose& pose = odom_msg.pose.pose;
+    record.position[0] = pose.position.x;
+    record.position[1] = pose.position.y;
+    record.position[2] = pose.position.z;
+    record.orientation[0] = pose.orientation.x;
+    record.orientation[1] = pose.orientation.y;
+    record.orientation[2] = pose.orientation.z;
+    record.orientation[3] = pose.orientation.w;
+    const geometry_msgs::Twist& twist = odom_msg.twist.twist;
+    record.linear_velocity[0] = twist.linear.x;
+    record.linear_velocity[1] = twist.linear.y;
+    record.linear_velocity[2] = twist.linear.z;
+    record.angular_velocity[0] = twist.angular.x;
+    record.angular_velocity[1] = twist.angular.y;
+    record.angular_velocity[2] = twist.angular.z;
+    std::copy(odom_msg.pose.covariance.begin(), odom_msg.pose.covariance.end(),
+        record.pose_covariance);
+    std::copy(odom_msg.twist.covariance.begin(), odom_msg.twist.covariance.end(),
+        record.twist_covariance);
+    record.runtime = info.runtime;
+    record.queue_wait_time = info.queue_wait_time;
+    record.image_conversion_time = info.image_conversion_time;
+    record.depth_preparation_time = info.depth_preparation_time;
+    record.feature_detection_time = info.feature_detection_time;
+    record.depth_time = info.depth_time;
+    record.matching_time = info.matching_time;
+    record.depth_refinement_time = info.depth_refinement_time;
+    record.motion_estimation_time = info.motion_estimation_time;
+    record.visualization_time = info.visualization_time;
+    record.tf_lookup_time = info.tf_lookup_time;
+    record.motion_estimate_status_code = info.motion_estimate_status_code;
+    record.flags =
+      (info.motion_estimate_valid ? TraceRecord::MOTION_ESTIMATE_VALID : 0) |
+      (info.change_reference_frame ? TraceRecord::CHANGE_REFERENCE_FRAME : 0) |
+      (info.motion_prior_used ? TraceRecord::MOTION_PRIOR_USED : 0);
+    record.fast_threshold = info.fast_threshold;
+    record.num_matches = info.num_matches;
+    record.num_inliers = info.num_inliers;
+    record.num_reprojection_failures = info.num_reprojection_failures;
+    record.num_total_detected_keypoints = info.num_total_detected_keypoints;
+    record.num_total_keypoints = info.num_total_keypoints;
+    record.num_skipped_frames = info.num_skipped_frames;
+    record.num_dropped_tuples = info.num_dropped_tuples;
+    int num_levels = std::min(static_cast<int>(TraceRecord::MAX_LEVELS),
+        static_cast<int>(std::min(info.num_detected_keypoints.size(),
+            info.num_keypoints.size())));
+    record.num_levels = num_levels;
+    record.reserved = 0;
+    for (int i = 0; i < TraceRecord::MAX_LEVELS; ++i)
+    {
+      record.num_detected_keypoints[i] = i < num_levels ? info.num_detected_keypoints[i] : 0;
+      record.num_keypoints[i] = i < num_levels ? info.num_keypoints[i] : 0;
+    }
+    trace_recorder_.commit();
+  }
+
+  /**
+   * Sets the pose covariance to the covariance of the reference frame
+   * plus the uncertainty of the motion since that frame. fovis reports
+   * the covariance of the motion from the reference keyframe to the
+   * current frame, not from the previous frame, so it must not be added
+   * up per frame. The covariance is kept for perturbations exp(xi) * pose
+   * in the odom frame, where the motion covariance maps in through the
+   * adjoint of the new sensor pose, so no Jacobians of the earlier motions
+   * are needed.
+   * \param sensor_pose Pose of the sensor in the odom frame after the motion
+   * \param motion_cov Covariance of the motion in the sensor frame
+   */
+  void updatePoseCovariance(const Eigen::Isometry3d& sensor_pose,
+      const Eigen::Matrix<double, 6, 6>& motion_cov)
+  {
+    Eigen::Matrix<double, 6, 6> adjoint;
+    getAdjoint(sensor_pose, adjoint);
+    pose_covariance_ = reference_pose_covariance_;
+    pose_covariance_.noalias() += adjoint * motion_cov * adjoint.transpose();
+  }
+
+  /**
+   * Converts the integrated covariance to position and orientation errors
+   * in the odom frame, rotations about the base origin, as expected in
+   * nav_msgs/Odometry, and writes it in row major order.
+   */
+  void fillPoseCovariance(const Eigen::Isometry3d& base_pose, double* covariance) const
+  {
+    // position error = rho + phi x position
+    Eigen::Matrix<double, 6, 6> jacobian = Eigen::Matrix<double, 6, 6>::Identity();
+    jacobian.topRightCorner<3, 3>() = -skew(base_pose.translation());
+    Covariance::Map(covariance) =
+      jacobian * pose_covariance_ * jacobian.transpose();
+  }
+
+  /**
+   * Adjoint of a rigid transform for twists ordered as translation,
+   * rotation.
+   */
+  static void getAdjoint(const Eigen::Isometry3d& transform,
+      Eigen::Matrix<double, 6, 6>& adjoint)
+  {
+    const Eigen::Matrix3d& rotation = transform.linear();
+    adjoint.topLeftCorner<3, 3>() = rotation;
+    adjoint.topRightCorner<3, 3>() = skew(transform.translation()) * rotation;
+    adjoint.bottomLeftCorner<3, 3>().setZero();
+    adjoint.bottomRightCorner<3, 3>() = rotation;
+  }
+
+  static Eigen::Matrix3d skew(const Eigen::Vector3d& v)
+  {
+    Eigen::Matrix3d m;
+    m <<     0, -v.z(),  v.y(),
+         v.z(),      0, -v.x(),
+        -v.y(),  v.x(),      0;
+    return m;
+  }
+
+  /**
+   * Adds the sensor motion since the last frame, as seen from
+   * ~motion_prior_frame_id, to the pose correction.
+   * \param fovis_pose Pose of the failed frame as reported by fovis
+   * \return false if the motion is not available
+   */
+  bool applyMotionPrior(const Eigen::Isometry3d& fovis_pose,
+      const std_msgs::Header& image_header)
+  {
+    if (last_frame_time_.isZero()) return false;
+    tf::StampedTransform motion;
+    try
+    {
+      // pose of the sensor now in the sensor frame of the last frame
+      tf_listener_->lookupTransform(image_header.frame_id, last_frame_time_,
+          image_header.frame_id, image_header.stamp,
+          motion_prior_frame_id_, motion);
+    }
+    catch (const tf::TransformException& e)
+    {
+      ROS_WARN_THROTTLE(10.0, "Motion prior from '%s' not available: %s",
+          motion_prior_frame_id_.c_str(), e.what());
+      return false;
+    }
+    // the corrected pose has to move by motion, this is the
+    // same as moving the uncorrected pose in its own frame
+    Eigen::Isometry3d sensor_motion;
+    tfToEigen(motion, sensor_motion);
+    pose_correction_ = pose_correction_ * fovis_pose * sensor_motion * fovis_pose.inverse();
+    return true;
+  }
+
+  /**
+   * Deadline mode, decides whether the current frame is skipped to
+   * keep up with the input rate.
+   */
+  bool isFrameSkipped()
+  {
+    if (num_skipped_frames_ < frame_skip_)
+    {
+      ++num_skipped_frames_;
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * Deadline mode, averages the processing time of the frames and derives
+   * how many frames to skip after each processed one, so that the
+   * average time per input frame stays within ~frame_budget.
+   */
+  void updateFrameSkip(double processing_time, FovisInfo* fovis_info_msg)
+  {
+    if (fovis_info_msg)
+    {
+      fovis_info_msg->num_skipped_frames = num_skipped_frames_;
+      fovis_info_msg->frame_budget = frame_budget_;
+    }
+    num_skipped_frames_ = 0;
+    if (frame_budget_ <= 0.0) return;
+    // exponential moving average, reacts within a few frames
+    average_processing_time_ = average_processing_time_ == 0.0 ?
+      processing_time :
+      0.8 * average_processing_time_ + 0.2 * processing_time;
+    int frame_skip = static_cast<int>(
+        std::ceil(average_processing_time_ / frame_budget_)) - 1;
+    frame_skip = std::max(0, std::min(frame_skip, max_skipped_frames_));
+    if (frame_skip != frame_skip_)
+    {
+      ROS_DEBUG("Average processing time %.1f ms, frame budget %.1f ms, "
+                "processing every %d. frame.", average_processing_time_ * 1000,
+                frame_budget_ * 1000, frame_skip + 1);
+    }
+    frame_skip_ = frame_skip;
+    if (fovis_info_msg)
+    {
+      fovis_info_msg->frame_skip = frame_skip_;
+      fovis_info_msg->average_processing_time = average_processing_time_;
+    }
+  }
+
+  /**
+   * Checks whether enough time has passed since the last features image
+   * to respect the configured features rate.
+   */
+  bool isFeaturesImageDue(const ros::Time& stamp) const
+  {
+    if (features_rate_ <= 0.0 || last_features_time_.isZero())
+      return true;
+    return (stamp - last_features_time_).toSec() >= 1.0 / features_rate_ ||
+      stamp < last_features_time_;
+  }
+
+  /**
+   * Publishes results in pipelined mode.
+   */
+  void runPublisher()
+  {
+    OdometryResultPtr result;
+    while (result_queue_.pop(result))
+    {
+      publish(*result);
+      result.reset();
+    }
+  }
+
+  /**
+   * Builds odometer and depth source from received camera infos unless
+   * that has been done already for the same calibration, e.g. from the
+   * cache, and updates ~calibration_file.
+   */
+  void initializeLocked(const CameraInfos& infos)
+  {
+    calibration_confirmed_ = true;
+    if (visual_odometer_ != NULL)
+    {
+      if (calibration_cache::isSameCalibration(infos, init_infos_)) return;
+      ROS_WARN("Camera infos differ from the cached calibration, "
+               "initializing again.");
+    }
+    buildOdometer(infos);
+    if (!calibration_file_.empty() &&
+        !calibration_cache::save(calibration_file_, infos))
+    {
+      ROS_WARN("Cannot write calibration file '%s'.", calibration_file_.c_str());
+    }
+  }
+
+  /**
+   * Creates the depth source and the visual odometry, replacing the ones
+   * built from an earlier calibration. No frame has been processed with
+   * those, so there is no odometry state to keep.
+   */
+  void buildOdometer(const CameraInfos& infos)
+  {
+    if (visual_odometer_) delete visual_odometer_;
+    if (rectification_) delete rectification_;
+    visual_odometer_ = NULL;
+    rectification_ = NULL;
+    // the resolution may differ from the cached or previous calibration
+    image_region_.reset();
+    setDepthSource(createDepthSource(infos));
+    initOdometer(infos[0]);
+    init_infos_ = infos;
+  }
 
   /**
    * Initializes the visual odometry. 
@@ -246,20 +1061,32 @@ private:
     model.fromCameraInfo(info_msg);
     fovis::CameraIntrinsicsParameters cam_params;
     rosToFovis(model, cam_params);
-    fovis::Rectification* rectification = new fovis::Rectification(cam_params);
+    adjustToImageRegion(cam_params);
+    // owned by us, fovis only keeps a pointer
+    rectification_ = new fovis::Rectification(cam_params);
+    image_buffer_.reserve(cam_params.width * cam_params.height);
+
+    if (max_keypoints_ > 0)
+    {
+      limitKeypoints(cam_params.width, cam_params.height);
+    }
 
     // instanciate odometer
     visual_odometer_ = 
-      new fovis::VisualOdometry(rectification, visual_odometer_options_);
+      new fovis::VisualOdometry(rectification_, visual_odometer_options_);
 
-    // store initial transform for later usage
-    getBaseToSensorTransform(info_msg->header.stamp, 
-        info_msg->header.frame_id,
-        initial_base_to_sensor_);
+    // the calling thread takes part in the work,
+    // a shared pool is used as it is
+    if (!thread_pool_ && num_threads_ > 1)
+    {
+      thread_pool_.reset(new ThreadPool(num_threads_ - 1));
+    }
 
     // print options
     std::stringstream info;
-    info << "Initialized fovis odometry with the following options:\n";
+    info << "Initialized fovis odometry with "
+         << (thread_pool_ ? thread_pool_->getNumThreads() + 1 : 1)
+         << " thread(s) and the following options:\n";
     for (fovis::VisualOdometryOptions::iterator iter = visual_odometer_options_.begin();
         iter != visual_odometer_options_.end();
         ++iter)
@@ -271,6 +1098,98 @@ private:
     ROS_INFO_STREAM(info.str());
   }
 
+  /**
+   * Enables bucketing and derives the number of keypoints per bucket from
+   * ~max_keypoints, so that the number of keypoints over all pyramid
+   * levels, and with it the number of matches fed into the clique
+   * computation of the motion estimator, stays below that limit.
+   * If there are more buckets than ~max_keypoints, the buckets are
+   * enlarged and, as a last resort, pyramid levels are dropped.
+   */
+  void limitKeypoints(int width, int height)
+  {
+    // start from the configured values, not the ones of an earlier build
+    fovis::VisualOdometryOptions options = configured_options_;
+    if (!options.count("bucket-width") || !options.count("bucket-height") ||
+        !options.count("max-pyramid-level") ||
+        !options.count("max-keypoints-per-bucket"))
+    {
+      ROS_WARN("This version of fovis does not support bucketing, "
+               "ignoring ~max_keypoints.");
+      return;
+    }
+    try
+    {
+      int bucket_width = boost::lexical_cast<int>(options["bucket-width"]);
+      int bucket_height = boost::lexical_cast<int>(options["bucket-height"]);
+      int num_levels = boost::lexical_cast<int>(options["max-pyramid-level"]) + 1;
+      int max_per_bucket =
+        boost::lexical_cast<int>(options["max-keypoints-per-bucket"]);
+      if (bucket_width < 1 || bucket_height < 1 || num_levels < 1)
+      {
+        ROS_WARN("Invalid bucketing options, ignoring ~max_keypoints.");
+        return;
+      }
+      int configured_num_buckets = countBuckets(width, height, bucket_width,
+          bucket_height, num_levels);
+      int num_buckets = configured_num_buckets;
+      // every bucket keeps at least one keypoint
+      while (num_buckets > max_keypoints_ &&
+          (bucket_width < width || bucket_height < height))
+      {
+        bucket_width = std::min(2 * bucket_width, width);
+        bucket_height = std::min(2 * bucket_height, height);
+        num_buckets = countBuckets(width, height, bucket_width,
+            bucket_height, num_levels);
+      }
+      while (num_buckets > max_keypoints_ && num_levels > 1)
+      {
+        --num_levels;
+        num_buckets = countBuckets(width, height, bucket_width,
+            bucket_height, num_levels);
+      }
+      if (num_buckets != configured_num_buckets)
+      {
+        ROS_WARN("~max_keypoints %d is less than the number of buckets, "
+            "using %dx%d buckets and %d pyramid level(s).", max_keypoints_,
+            bucket_width, bucket_height, num_levels);
+      }
+      max_per_bucket = std::min(max_per_bucket, max_keypoints_ / num_buckets);
+      options["use-bucketing"] = "true";
+      options["bucket-width"] = boost::lexical_cast<std::string>(bucket_width);
+      options["bucket-height"] = boost::lexical_cast<std::string>(bucket_height);
+      options["max-pyramid-level"] =
+        boost::lexical_cast<std::string>(num_levels - 1);
+      options["max-keypoints-per-bucket"] =
+        boost::lexical_cast<std::string>(max_per_bucket);
+      visual_odometer_options_ = options;
+      ROS_INFO("Limiting keypoints to %d per bucket in %d buckets.",
+          max_per_bucket, num_buckets);
+    }
+    catch (const boost::bad_lexical_cast&)
+    {
+      ROS_WARN("Invalid bucketing options, ignoring ~max_keypoints.");
+    }
+  }
+
+  /**
+   * Number of buckets over all pyramid levels, each level has half the
+   * size of the one below.
+   */
+  static int countBuckets(int width, int height, int bucket_width,
+      int bucket_height, int num_levels)
+  {
+    int num_buckets = 0;
+    for (int level = 0; level < num_levels; ++level)
+    {
+      int level_width = width >> level;
+      int level_height = height >> level;
+      num_buckets += ((level_width + bucket_width - 1) / bucket_width) *
+        ((level_height + bucket_height - 1) / bucket_height);
+    }
+    return num_buckets;
+  }
+
   /**
    * Loads parameters from ROS node handle into members.
    */
@@ -279,6 +1198,19 @@ private:
     nh_local_.param("odom_frame_id", odom_frame_id_, std::string("/odom"));
     nh_local_.param("base_link_frame_id", base_link_frame_id_, std::string("/base_link"));
     nh_local_.param("publish_tf", publish_tf_, true);
+    nh_local_.param("motion_prior_frame_id", motion_prior_frame_id_, std::string());
+    nh_local_.param("static_sensor_mount", static_sensor_mount_, false);
+    nh_local_.param("sensor_mount_refresh_period", sensor_mount_refresh_period_, 0.0);
+    nh_local_.param("pipelined", pipelined_, false);
+    nh_local_.param("features_rate", features_rate_, 0.0);
+    nh_local_.param("num_threads", num_threads_, 1);
+    nh_local_.param("max_keypoints", max_keypoints_, 0);
+    nh_local_.param("frame_budget", frame_budget_, 0.0);
+    nh_local_.param("trace_file", trace_file_, std::string());
+    nh_local_.param("trace_capacity", trace_capacity_, 100000);
+    nh_local_.param("max_skipped_frames", max_skipped_frames_, 3);
+    nh_local_.param("calibration_file", calibration_file_, std::string());
+    image_region_.loadParams(nh_local_);
 
     for (fovis::VisualOdometryOptions::iterator iter = visual_odometer_options_.begin();
         iter != visual_odometer_options_.end();
@@ -299,19 +1231,50 @@ private:
         visual_odometer_options_[iter->first] = value;
       }
     }
+    configured_options_ = visual_odometer_options_;
+  }
+
+  /**
+   * Updates base_to_sensor_ and sensor_to_base_ for the given frame. With
+   * ~static_sensor_mount the transform is looked up until it is available
+   * once and then only every ~sensor_mount_refresh_period seconds, if
+   * that is greater than 0.
+   */
+  void updateBaseToSensorTransform(const ros::Time& stamp,
+      const std::string& sensor_frame_id)
+  {
+    if (static_sensor_mount_ && !base_to_sensor_stamp_.isZero())
+    {
+      double age = (stamp - base_to_sensor_stamp_).toSec();
+      // a jump back in time (e.g. a restarted bag) forces a refresh
+      if (sensor_mount_refresh_period_ <= 0.0 ||
+          (age >= 0.0 && age < sensor_mount_refresh_period_))
+        return;
+    }
+    tf::StampedTransform base_to_sensor;
+    if (getBaseToSensorTransform(stamp, sensor_frame_id, base_to_sensor))
+    {
+      base_to_sensor_stamp_ = stamp;
+    }
+    tfToEigen(base_to_sensor, base_to_sensor_);
+    sensor_to_base_ = base_to_sensor_.inverse();
   }
 
-  void getBaseToSensorTransform(const ros::Time& stamp, 
+  /**
+   * \return false if the transform is not available and identity is used
+   */
+  bool getBaseToSensorTransform(const ros::Time& stamp, 
       const std::string& sensor_frame_id, tf::StampedTransform& base_to_sensor)
   {
     std::string error_msg;
-    if (tf_listener_.canTransform(
+    if (tf_listener_->canTransform(
           base_link_frame_id_, sensor_frame_id, stamp, &error_msg))
     {
-      tf_listener_.lookupTransform(
+      tf_listener_->lookupTransform(
           base_link_frame_id_,
           sensor_frame_id,
           stamp, base_to_sensor);
+      return true;
     }
     else
     {
@@ -321,6 +1284,7 @@ private:
                               sensor_frame_id.c_str());
       ROS_DEBUG("Transform error: %s", error_msg.c_str());
       base_to_sensor.setIdentity();
+      return false;
     }
   }
 
@@ -334,6 +1298,14 @@ private:
     transform = tf::Transform(quat, origin);
   }
 
+  static void tfToEigen(const tf::Transform& transform, Eigen::Isometry3d& pose)
+  {
+    tf::Vector3 origin = transform.getOrigin();
+    tf::Quaternion quat = transform.getRotation();
+    pose = Eigen::Translation3d(origin.x(), origin.y(), origin.z()) *
+      Eigen::Quaterniond(quat.w(), quat.x(), quat.y(), quat.z());
+  }
+
 
 private:
 
@@ -341,16 +1313,75 @@ private:
   fovis::Rectification* rectification_;
   fovis::DepthSource* depth_source_;
   fovis::VisualOdometryOptions visual_odometer_options_;
+  // as read from the parameters, before ~max_keypoints is applied
+  fovis::VisualOdometryOptions configured_options_;
+  bool has_reference_frame_;
+
+  // initialization, possibly before the first frame
+  boost::mutex init_mutex_;
+  bool calibration_confirmed_;
+  std::string calibration_file_;
+  CameraInfos init_infos_;
+  CameraInfos pending_infos_;
+
+  // instrumentation
+  StageTimes stage_times_;
+  TimedDepthSource timed_depth_source_;
+
+  // input conversion
+  std::vector<uint8_t> image_buffer_;
+  // counted from concurrent tasks
+  boost::detail::atomic_count num_image_conversions_;
+  boost::detail::atomic_count num_image_copies_;
+
+  // frame preparation
+  ImageRegion image_region_;
+  static const size_t NUM_PREPARATION_TASKS = 2;
+  static const int MIN_BAND_ROWS = 32;
+  ThreadPool::IndexedTask preparation_task_;
+  const sensor_msgs::ImageConstPtr* current_image_msg_;
+  const DepthPreparation* current_prepare_depth_;
+  cv_bridge::CvImageConstPtr cv_ptr_;
+  const uint8_t* image_data_;
+  bool depth_ok_;
+  int num_threads_;
+  boost::shared_ptr<ThreadPool> thread_pool_;
+  int max_keypoints_;
+
+  // deadline mode
+  double frame_budget_;
+  int max_skipped_frames_;
+  double average_processing_time_;
+  int frame_skip_;
+  int num_skipped_frames_;
 
   ros::Time last_time_;
 
+  // motion prior
+  std::string motion_prior_frame_id_;
+  ros::Time last_frame_time_;
+  Eigen::Isometry3d pose_correction_;
+
+  // pose covariance of the current and the reference frame,
+  // see updatePoseCovariance()
+  typedef Eigen::Matrix<double, 6, 6, Eigen::RowMajor> Covariance;
+  Eigen::Matrix<double, 6, 6> pose_covariance_;
+  Eigen::Matrix<double, 6, 6> reference_pose_covariance_;
+
   // tf related
   std::string sensor_frame_id_;
   std::string odom_frame_id_;
   std::string base_link_frame_id_;
   bool publish_tf_;
-  tf::StampedTransform initial_base_to_sensor_;
-  tf::TransformListener tf_listener_;
+  bool has_initial_base_to_sensor_;
+  Eigen::Isometry3d initial_base_to_sensor_;
+  // current transform and its inverse, cached with a static mount
+  bool static_sensor_mount_;
+  double sensor_mount_refresh_period_;
+  ros::Time base_to_sensor_stamp_;
+  Eigen::Isometry3d base_to_sensor_;
+  Eigen::Isometry3d sensor_to_base_;
+  boost::shared_ptr<tf::TransformListener> tf_listener_;
   tf::TransformBroadcaster tf_broadcaster_;
 
   ros::NodeHandle nh_local_;
@@ -361,7 +1392,33 @@ private:
   ros::Publisher info_pub_;
   image_transport::Publisher features_pub_;
   image_transport::ImageTransport it_;
+
+  // reused output messages
+  MessagePool<nav_msgs::Odometry> odom_msgs_;
+  MessagePool<geometry_msgs::PoseStamped> pose_msgs_;
+  MessagePool<FovisInfo> info_msgs_;
+  bool info_required_;
+
+  // visualization
+  double features_rate_;
+  ros::Time last_features_time_;
+  boost::scoped_ptr<FeaturePainter> feature_painter_;
+  // image of the current reference frame, painted without a copy
+  sensor_msgs::ImageConstPtr reference_image_msg_;
+
+  // binary trace
+  std::string trace_file_;
+  int trace_capacity_;
+  TraceRecorder trace_recorder_;
+
+  // pipelined mode
+  static const size_t RESULT_QUEUE_SIZE = 10;
+  bool pipelined_;
+  BoundedQueue<OdometryResultPtr> result_queue_;
+  std::vector<OdometryResultPtr> results_;
+  boost::thread publisher_thread_;
 };
 
 } // end of namespace
 
+#endif
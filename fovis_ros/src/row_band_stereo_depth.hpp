@@ -0,0 +1,461 @@
+#ifndef ROW_BAND_STEREO_DEPTH_H_
+#define ROW_BAND_STEREO_DEPTH_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <boost/lexical_cast.hpp>
+
+#include <fovis/depth_source.hpp>
+#include <fovis/frame.hpp>
+#include <fovis/camera_intrinsics.hpp>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define FOVIS_ROS_ROW_BAND_STEREO_SSE2
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FOVIS_ROS_ROW_BAND_STEREO_NEON
+#endif
+
+namespace fovis_ros
+{
+
+/**
+ * Stereo depth source for rectified image pairs that searches the
+ * disparity of each keypoint along its row of the right image, like
+ * fovis::StereoDepth, but without building a right image pyramid.
+ * The keypoints of all pyramid levels are matched at full resolution
+ * in the order of their rows, so the patch descriptors of a row band
+ * are computed once and shared by all keypoints on that row, both
+ * for the search in the right image and for the mutual check in the
+ * left image. The patches are compared by the sum of absolute
+ * differences of their mean free intensities, on SSE2 and NEON
+ * capable targets with vector instructions.
+ *
+ * The fovis options "stereo-max-disparity",
+ * "stereo-require-mutual-match" and "stereo-max-refinement-displacement"
+ * are used with the same meaning as in fovis::StereoDepth.
+ */
+class RowBandStereoDepth : public fovis::DepthSource
+{
+
+public:
+
+  /**
+   * \param left_parameters Intrinsics of the processed left image
+   * \param baseline Distance of the cameras in meters
+   * \param disparity_offset Difference of the principal points of the
+   *                         left and right camera in x, which is part
+   *                         of the image disparity
+   * \param options The visual odometry options
+   */
+  RowBandStereoDepth(const fovis::CameraIntrinsicsParameters& left_parameters,
+      double baseline, double disparity_offset,
+      const fovis::VisualOdometryOptions& options) :
+    left_parameters_(left_parameters),
+    baseline_(baseline),
+    disparity_offset_(disparity_offset),
+    width_(left_parameters.width),
+    height_(left_parameters.height),
+    max_disparity_(getOption<int>(options, "stereo-max-disparity", 128)),
+    require_mutual_match_(true),
+    max_refinement_displacement_(
+        getOption<double>(options, "stereo-max-refinement-displacement", 1.0)),
+    right_image_(NULL),
+    left_cache_(width_),
+    right_cache_(width_),
+    costs_(std::max(max_disparity_, 0) + 1)
+  {
+    fovis::VisualOdometryOptions::const_iterator mutual_match =
+      options.find("stereo-require-mutual-match");
+    if (mutual_match != options.end())
+      require_mutual_match_ = mutual_match->second == "true";
+  }
+
+  /**
+   * Sets the right image for the next frame, the data must stay valid
+   * until the frame is processed.
+   * \param data Processed region of the right image without row padding
+   */
+  void setRightImage(const uint8_t* data)
+  {
+    right_image_ = data;
+    right_cache_.setImage(data, width_);
+  }
+
+  virtual bool haveXyz(int u, int v)
+  {
+    return u >= PATCH_RADIUS && u + PATCH_RADIUS <= width_ &&
+      v >= PATCH_RADIUS && v + PATCH_RADIUS <= height_;
+  }
+
+  virtual void getXyz(fovis::OdometryFrame* frame)
+  {
+    setLeftImage(frame, true);
+    requests_.clear();
+    for (int level_num = 0; level_num < frame->getNumLevels(); ++level_num)
+    {
+      fovis::PyramidLevel* level = frame->getLevel(level_num);
+      for (int kp_ind = 0; kp_ind < level->getNumKeypoints(); ++kp_ind)
+      {
+        addRequest(level->getKeypointData(kp_ind), NULL);
+      }
+    }
+    std::sort(requests_.begin(), requests_.end());
+    for (size_t i = 0; i < requests_.size(); ++i)
+    {
+      const Request& request = requests_[i];
+      setXyz(request.kpdata, request.u, request.v, request.du);
+    }
+  }
+
+  virtual void refineXyz(fovis::FeatureMatch* matches, int num_matches,
+      fovis::OdometryFrame* frame)
+  {
+    setLeftImage(frame, false);
+    requests_.clear();
+    for (int m_ind = 0; m_ind < num_matches; ++m_ind)
+    {
+      fovis::FeatureMatch& match = matches[m_ind];
+      if (match.status == fovis::MATCH_NEEDS_DEPTH_REFINEMENT)
+        addRequest(&match.refined_target_keypoint, &match);
+    }
+    std::sort(requests_.begin(), requests_.end());
+    for (size_t i = 0; i < requests_.size(); ++i)
+    {
+      const Request& request = requests_[i];
+      fovis::KeypointData* kpdata = request.kpdata;
+      setXyz(kpdata, request.u, request.v, request.du);
+      float disparity = request.match->target_keypoint->disparity;
+      if (kpdata->has_depth && !std::isnan(disparity) &&
+          std::fabs(kpdata->disparity - disparity) > max_refinement_displacement_)
+        setInvalid(kpdata);
+      if (kpdata->has_depth)
+      {
+        request.match->status = fovis::MATCH_OK;
+      }
+      else
+      {
+        request.match->status = fovis::MATCH_REFINEMENT_FAILED;
+        request.match->inlier = false;
+      }
+    }
+  }
+
+  virtual double getBaseline() const
+  {
+    return baseline_;
+  }
+
+private:
+
+  // patches are PATCH_SIZE x PATCH_SIZE pixels, the keypoint lies
+  // PATCH_RADIUS pixels from the top left corner
+  static const int PATCH_RADIUS = 4;
+  static const int PATCH_SIZE = 2 * PATCH_RADIUS;
+  static const int DESCRIPTOR_SIZE = PATCH_SIZE * PATCH_SIZE;
+
+  /**
+   * A keypoint at its full resolution pixel, the sub-pixel remainder
+   * is added to the disparity.
+   */
+  struct Request
+  {
+    int u;
+    int v;
+    double du;
+    fovis::KeypointData* kpdata;
+    fovis::FeatureMatch* match;
+
+    // row band order
+    bool operator<(const Request& other) const
+    {
+      return v < other.v || (v == other.v && u < other.u);
+    }
+  };
+
+  /**
+   * Descriptors of the patches of one image row. Each column is
+   * computed when it is first needed and kept until the row or the
+   * image changes.
+   */
+  class RowCache
+  {
+
+  public:
+
+    RowCache(int width) :
+      image_(NULL),
+      stride_(0),
+      row_(-1),
+      stamp_(1),
+      descriptors_(width * DESCRIPTOR_SIZE),
+      stamps_(width, 0)
+    {
+    }
+
+    void setImage(const uint8_t* image, int stride)
+    {
+      image_ = image;
+      stride_ = stride;
+      row_ = -1;
+      nextStamp();
+    }
+
+    const uint8_t* getImage() const
+    {
+      return image_;
+    }
+
+    void setRow(int row)
+    {
+      if (row == row_) return;
+      row_ = row;
+      nextStamp();
+    }
+
+    /**
+     * \return the descriptor of the patch around the given column
+     *         of the current row
+     */
+    const uint8_t* getDescriptor(int column)
+    {
+      uint8_t* descriptor = &descriptors_[column * DESCRIPTOR_SIZE];
+      if (stamps_[column] != stamp_)
+      {
+        computeDescriptor(column, descriptor);
+        stamps_[column] = stamp_;
+      }
+      return descriptor;
+    }
+
+  private:
+
+    void nextStamp()
+    {
+      // columns with an old stamp are invalid, the stamps only need
+      // to be cleared when the counter wraps
+      if (++stamp_ == 0)
+      {
+        std::fill(stamps_.begin(), stamps_.end(), 0);
+        stamp_ = 1;
+      }
+    }
+
+    /**
+     * Stores the patch minus its mean intensity, shifted to the middle
+     * of the value range, so the comparison is invariant to brightness
+     * differences of the cameras.
+     */
+    void computeDescriptor(int column, uint8_t* descriptor) const
+    {
+      const uint8_t* patch =
+        image_ + (row_ - PATCH_RADIUS) * stride_ + column - PATCH_RADIUS;
+      int sum = 0;
+      for (int y = 0; y < PATCH_SIZE; ++y)
+      {
+        const uint8_t* patch_row = patch + y * stride_;
+        for (int x = 0; x < PATCH_SIZE; ++x)
+          sum += patch_row[x];
+      }
+      int offset = 128 - (sum + DESCRIPTOR_SIZE / 2) / DESCRIPTOR_SIZE;
+      for (int y = 0; y < PATCH_SIZE; ++y)
+      {
+        const uint8_t* patch_row = patch + y * stride_;
+        for (int x = 0; x < PATCH_SIZE; ++x)
+        {
+          int value = patch_row[x] + offset;
+          descriptor[y * PATCH_SIZE + x] =
+            static_cast<uint8_t>(std::min(std::max(value, 0), 255));
+        }
+      }
+    }
+
+    const uint8_t* image_;
+    int stride_;
+    int row_;
+    unsigned int stamp_;
+    std::vector<uint8_t> descriptors_;
+    std::vector<unsigned int> stamps_;
+  };
+
+  template <typename T>
+  static T getOption(const fovis::VisualOdometryOptions& options,
+      const std::string& name, T default_value)
+  {
+    fovis::VisualOdometryOptions::const_iterator option = options.find(name);
+    if (option == options.end())
+      return default_value;
+    try
+    {
+      return boost::lexical_cast<T>(option->second);
+    }
+    catch (const boost::bad_lexical_cast&)
+    {
+      return default_value;
+    }
+  }
+
+  /**
+   * The left image is the full resolution level of the frame. The
+   * cache is kept for the refinement of the frame it was built for.
+   */
+  void setLeftImage(fovis::OdometryFrame* frame, bool new_frame)
+  {
+    const fovis::PyramidLevel* level = frame->getLevel(0);
+    if (new_frame || level->getGrayscaleImage() != left_cache_.getImage())
+    {
+      left_cache_.setImage(level->getGrayscaleImage(),
+          level->getGrayscaleImageStride());
+    }
+  }
+
+  void addRequest(fovis::KeypointData* kpdata, fovis::FeatureMatch* match)
+  {
+    Request request;
+    request.u = static_cast<int>(std::floor(kpdata->base_uv(0) + 0.5));
+    request.v = static_cast<int>(std::floor(kpdata->base_uv(1) + 0.5));
+    request.du = kpdata->base_uv(0) - request.u;
+    request.kpdata = kpdata;
+    request.match = match;
+    requests_.push_back(request);
+  }
+
+  static int computeSad(const uint8_t* a, const uint8_t* b)
+  {
+#if defined(FOVIS_ROS_ROW_BAND_STEREO_SSE2)
+    __m128i sum = _mm_setzero_si128();
+    for (int i = 0; i < DESCRIPTOR_SIZE; i += 16)
+    {
+      __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+      __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+      sum = _mm_add_epi64(sum, _mm_sad_epu8(va, vb));
+    }
+    return _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+#elif defined(FOVIS_ROS_ROW_BAND_STEREO_NEON)
+    // 64 differences of at most 255 fit into 16 bit lanes
+    uint16x8_t sum = vabdl_u8(vld1_u8(a), vld1_u8(b));
+    for (int i = 8; i < DESCRIPTOR_SIZE; i += 8)
+      sum = vabal_u8(sum, vld1_u8(a + i), vld1_u8(b + i));
+    uint64x2_t sum64 = vpaddlq_u32(vpaddlq_u16(sum));
+    return static_cast<int>(vgetq_lane_u64(sum64, 0) + vgetq_lane_u64(sum64, 1));
+#else
+    int sum = 0;
+    for (int i = 0; i < DESCRIPTOR_SIZE; ++i)
+      sum += std::abs(static_cast<int>(a[i]) - static_cast<int>(b[i]));
+    return sum;
+#endif
+  }
+
+  /**
+   * Searches the row of the right image for the patch around (u, v) of
+   * the left image and computes the depth from the disparity.
+   * \param du Sub-pixel offset of the keypoint from u
+   */
+  void setXyz(fovis::KeypointData* kpdata, int u, int v, double du)
+  {
+    if (!right_image_ || !haveXyz(u, v))
+    {
+      setInvalid(kpdata);
+      return;
+    }
+    left_cache_.setRow(v);
+    right_cache_.setRow(v);
+    const uint8_t* left_descriptor = left_cache_.getDescriptor(u);
+
+    int max_disparity = std::min(max_disparity_, u - PATCH_RADIUS);
+    int best_disparity = -1;
+    int best_cost = std::numeric_limits<int>::max();
+    for (int d = 0; d <= max_disparity; ++d)
+    {
+      costs_[d] = computeSad(left_descriptor, right_cache_.getDescriptor(u - d));
+      if (costs_[d] < best_cost)
+      {
+        best_cost = costs_[d];
+        best_disparity = d;
+      }
+    }
+    // the best match must not lie at the end of the search range
+    if (best_disparity <= 0 || best_disparity >= max_disparity)
+    {
+      setInvalid(kpdata);
+      return;
+    }
+
+    if (require_mutual_match_)
+    {
+      // the patch of the right image must match best at u in the
+      // left image as well
+      int right_u = u - best_disparity;
+      const uint8_t* right_descriptor = right_cache_.getDescriptor(right_u);
+      int max_left_u = std::min(right_u + max_disparity_, width_ - PATCH_RADIUS);
+      for (int left_u = right_u; left_u <= max_left_u; ++left_u)
+      {
+        if (left_u != u && computeSad(left_cache_.getDescriptor(left_u),
+              right_descriptor) < best_cost)
+        {
+          setInvalid(kpdata);
+          return;
+        }
+      }
+    }
+
+    // fit a parabola to the costs around the minimum
+    double disparity = best_disparity;
+    int previous_cost = costs_[best_disparity - 1];
+    int next_cost = costs_[best_disparity + 1];
+    int curvature = previous_cost - 2 * best_cost + next_cost;
+    if (curvature > 0)
+      disparity += 0.5 * (previous_cost - next_cost) / curvature;
+    disparity += du;
+
+    if (!(disparity - disparity_offset_ > 0))
+    {
+      setInvalid(kpdata);
+      return;
+    }
+    double z = left_parameters_.fx * baseline_ / (disparity - disparity_offset_);
+    kpdata->has_depth = true;
+    kpdata->disparity = disparity;
+    kpdata->xyz(0) = (kpdata->rect_base_uv(0) - left_parameters_.cx) * z / left_parameters_.fx;
+    kpdata->xyz(1) = (kpdata->rect_base_uv(1) - left_parameters_.cy) * z / left_parameters_.fy;
+    kpdata->xyz(2) = z;
+    kpdata->xyzw.head<3>() = kpdata->xyz;
+    kpdata->xyzw(3) = 1;
+  }
+
+  static void setInvalid(fovis::KeypointData* kpdata)
+  {
+    kpdata->has_depth = false;
+    kpdata->disparity = std::numeric_limits<float>::quiet_NaN();
+    kpdata->xyzw = Eigen::Vector4d::Constant(std::numeric_limits<double>::quiet_NaN());
+    kpdata->xyz = Eigen::Vector3d::Constant(std::numeric_limits<double>::quiet_NaN());
+  }
+
+  fovis::CameraIntrinsicsParameters left_parameters_;
+  double baseline_;
+  double disparity_offset_;
+  int width_;
+  int height_;
+  int max_disparity_;
+  bool require_mutual_match_;
+  double max_refinement_displacement_;
+
+  const uint8_t* right_image_;
+  RowCache left_cache_;
+  RowCache right_cache_;
+  // matching costs of the current keypoint, indexed by disparity
+  std::vector<int> costs_;
+  std::vector<Request> requests_;
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef SHARED_RESOURCES_H_
+#define SHARED_RESOURCES_H_
+
+#include <boost/shared_ptr.hpp>
+#include <tf/transform_listener.h>
+
+#include "thread_pool.hpp"
+
+namespace fovis_ros
+{
+
+/**
+ * Resources that several odometers in one process can share. Empty
+ * pointers mean that each odometer creates its own.
+ */
+struct SharedResources
+{
+  /// tf buffer used for the base to sensor transform and the motion prior
+  boost::shared_ptr<tf::TransformListener> tf_listener;
+  /// pool that processes the frames of all odometers, replaces the
+  /// worker threads of ~pipelined and ~num_threads
+  boost::shared_ptr<ThreadPool> thread_pool;
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,253 @@
+#ifndef SPARSE_DEPTH_IMAGE_H_
+#define SPARSE_DEPTH_IMAGE_H_
+
+#include <cmath>
+#include <limits>
+
+#include <opencv2/core/core.hpp>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/image_encodings.h>
+#include <stereo_msgs/DisparityImage.h>
+
+#include <fovis/depth_source.hpp>
+#include <fovis/frame.hpp>
+#include <fovis/camera_intrinsics.hpp>
+
+#include "depth_conversion.hpp"
+
+namespace fovis_ros
+{
+
+/**
+ * Depth source that keeps a reference to the incoming depth message and
+ * reads depth only at the keypoint locations fovis asks for, instead of
+ * copying and rescaling the whole frame like fovis::DepthImage does.
+ * Accepts 32FC1 (meters) and 16UC1 (millimeters) depth images as well as
+ * disparity images that are registered to the intensity image, possibly
+ * at a different resolution.
+ * Only the region of the depth image that matches the processed region
+ * of the intensity image is used.
+ */
+class SparseDepthImage : public fovis::DepthSource
+{
+
+public:
+
+  /**
+   * \param rgb_parameters Intrinsics of the processed intensity image
+   * \param depth_width Width of the depth messages
+   * \param depth_height Height of the depth messages
+   * \param depth_roi Region of the depth image that covers the processed
+   *                  intensity image
+   */
+  SparseDepthImage(const fovis::CameraIntrinsicsParameters& rgb_parameters,
+      int depth_width, int depth_height, const cv::Rect& depth_roi) :
+    rgb_parameters_(rgb_parameters),
+    depth_width_(depth_width),
+    depth_height_(depth_height),
+    depth_roi_(depth_roi),
+    rgb_to_depth_scale_x_(static_cast<float>(depth_roi.width) / rgb_parameters.width),
+    rgb_to_depth_scale_y_(static_cast<float>(depth_roi.height) / rgb_parameters.height),
+    image_(NULL),
+    format_(DEPTH_32F),
+    disparity_factor_(0.0f),
+    min_disparity_(0.0f),
+    max_disparity_(0.0f)
+  {
+  }
+
+  /**
+   * Sets the depth image for the next frame, the message is referenced,
+   * not copied.
+   * \return false if the encoding or size of the image is not supported
+   */
+  bool setDepthImage(const sensor_msgs::ImageConstPtr& depth_msg)
+  {
+    if (!hasDepthSize(*depth_msg))
+      return false;
+    if (depth_msg->encoding == sensor_msgs::image_encodings::TYPE_32FC1)
+      format_ = DEPTH_32F;
+    else if (depth_msg->encoding == sensor_msgs::image_encodings::TYPE_16UC1)
+      format_ = DEPTH_16U;
+    else
+      return false;
+    depth_msg_ = depth_msg;
+    disparity_msg_.reset();
+    image_ = depth_msg_.get();
+    return true;
+  }
+
+  /**
+   * Sets the disparity image for the next frame, the message is
+   * referenced, not copied. Depth is computed from the disparity
+   * at the keypoints only.
+   * \return false if the encoding or size of the image is not supported
+   */
+  bool setDisparityImage(const stereo_msgs::DisparityImageConstPtr& disparity_msg)
+  {
+    if (!hasDepthSize(disparity_msg->image) ||
+        disparity_msg->image.encoding != sensor_msgs::image_encodings::TYPE_32FC1)
+      return false;
+    format_ = DISPARITY;
+    // depth = f * T / disparity
+    disparity_factor_ = disparity_msg->f * disparity_msg->T;
+    min_disparity_ = disparity_msg->min_disparity;
+    max_disparity_ = disparity_msg->max_disparity;
+    disparity_msg_ = disparity_msg;
+    depth_msg_.reset();
+    image_ = &disparity_msg_->image;
+    return true;
+  }
+
+  virtual bool haveXyz(int u, int v)
+  {
+    return !std::isnan(getDepth(u * rgb_to_depth_scale_x_, v * rgb_to_depth_scale_y_));
+  }
+
+  virtual void getXyz(fovis::OdometryFrame* frame)
+  {
+    for (int level_num = 0; level_num < frame->getNumLevels(); ++level_num)
+    {
+      fovis::PyramidLevel* level = frame->getLevel(level_num);
+      for (int kp_ind = 0; kp_ind < level->getNumKeypoints(); ++kp_ind)
+      {
+        fovis::KeypointData* kpdata = level->getKeypointData(kp_ind);
+        int u = static_cast<int>(kpdata->rect_base_uv(0) + 0.5);
+        int v = static_cast<int>(kpdata->rect_base_uv(1) + 0.5);
+        float z = getDepth(u * rgb_to_depth_scale_x_, v * rgb_to_depth_scale_y_);
+        setXyz(kpdata, z);
+      }
+    }
+  }
+
+  virtual void refineXyz(fovis::FeatureMatch* matches, int num_matches,
+      fovis::OdometryFrame* frame)
+  {
+    for (int m_ind = 0; m_ind < num_matches; ++m_ind)
+    {
+      fovis::FeatureMatch& match = matches[m_ind];
+      if (match.status == fovis::MATCH_NEEDS_DEPTH_REFINEMENT)
+      {
+        fovis::KeypointData* kpdata = &match.refined_target_keypoint;
+        float z = getDepthInterp(kpdata->rect_base_uv(0), kpdata->rect_base_uv(1));
+        setXyz(kpdata, z);
+        if (kpdata->has_depth)
+        {
+          match.status = fovis::MATCH_OK;
+        }
+        else
+        {
+          match.status = fovis::MATCH_REFINEMENT_FAILED;
+          match.inlier = false;
+        }
+      }
+    }
+  }
+
+  virtual double getBaseline() const
+  {
+    return 0;
+  }
+
+private:
+
+  /**
+   * Returns the depth at the given pixel of the depth region, NaN if
+   * invalid or outside of the region.
+   */
+  float getDepth(int du, int dv) const
+  {
+    if (du < 0 || dv < 0 || du >= depth_roi_.width || dv >= depth_roi_.height)
+      return std::numeric_limits<float>::quiet_NaN();
+    du += depth_roi_.x;
+    dv += depth_roi_.y;
+    const uint8_t* row = &image_->data[dv * image_->step];
+    if (format_ == DEPTH_16U)
+      return depth_converter_(reinterpret_cast<const uint16_t*>(row)[du]);
+    float value = reinterpret_cast<const float*>(row)[du];
+    if (format_ == DISPARITY)
+    {
+      // invalid disparities are marked with values below the minimum,
+      // this also rejects zero disparity (infinite depth)
+      if (!(value > 0 && value >= min_disparity_ && value <= max_disparity_))
+        return std::numeric_limits<float>::quiet_NaN();
+      return disparity_factor_ / value;
+    }
+    return value > 0 ? value : std::numeric_limits<float>::quiet_NaN();
+  }
+
+  bool hasDepthSize(const sensor_msgs::Image& image) const
+  {
+    return static_cast<int>(image.width) == depth_width_ &&
+      static_cast<int>(image.height) == depth_height_;
+  }
+
+  /**
+   * Bilinear interpolation of depth at the given intensity image
+   * location, NaN if any of the four neighbours is invalid.
+   */
+  float getDepthInterp(double u, double v) const
+  {
+    float du = u * rgb_to_depth_scale_x_;
+    float dv = v * rgb_to_depth_scale_y_;
+    int u0 = static_cast<int>(std::floor(du));
+    int v0 = static_cast<int>(std::floor(dv));
+    float wu = du - u0;
+    float wv = dv - v0;
+    float z00 = getDepth(u0, v0);
+    float z10 = getDepth(u0 + 1, v0);
+    float z01 = getDepth(u0, v0 + 1);
+    float z11 = getDepth(u0 + 1, v0 + 1);
+    // NaN propagates through the interpolation
+    return (1 - wv) * ((1 - wu) * z00 + wu * z10) +
+           wv * ((1 - wu) * z01 + wu * z11);
+  }
+
+  void setXyz(fovis::KeypointData* kpdata, float z) const
+  {
+    kpdata->disparity = std::numeric_limits<float>::quiet_NaN();
+    if (std::isnan(z))
+    {
+      kpdata->has_depth = false;
+      kpdata->xyzw = Eigen::Vector4d::Constant(std::numeric_limits<double>::quiet_NaN());
+      kpdata->xyz = Eigen::Vector3d::Constant(std::numeric_limits<double>::quiet_NaN());
+    }
+    else
+    {
+      kpdata->has_depth = true;
+      kpdata->xyz(0) = (kpdata->rect_base_uv(0) - rgb_parameters_.cx) * z / rgb_parameters_.fx;
+      kpdata->xyz(1) = (kpdata->rect_base_uv(1) - rgb_parameters_.cy) * z / rgb_parameters_.fy;
+      kpdata->xyz(2) = z;
+      kpdata->xyzw.head<3>() = kpdata->xyz;
+      kpdata->xyzw(3) = 1;
+    }
+  }
+
+  fovis::CameraIntrinsicsParameters rgb_parameters_;
+  int depth_width_;
+  int depth_height_;
+  cv::Rect depth_roi_;
+  float rgb_to_depth_scale_x_;
+  float rgb_to_depth_scale_y_;
+
+  enum Format
+  {
+    DEPTH_32F,
+    DEPTH_16U,
+    DISPARITY
+  };
+
+  // one of the messages is referenced, image_ points into it
+  sensor_msgs::ImageConstPtr depth_msg_;
+  stereo_msgs::DisparityImageConstPtr disparity_msg_;
+  const sensor_msgs::Image* image_;
+  Format format_;
+  float disparity_factor_;
+  float min_disparity_;
+  float max_disparity_;
+  DepthConverter depth_converter_;
+};
+
+} // end of namespace
+
+#endif
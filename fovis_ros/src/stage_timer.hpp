@@ -0,0 +1,68 @@
+#ifndef STAGE_TIMER_H_
+#define STAGE_TIMER_H_
+
+#include <ros/ros.h>
+
+namespace fovis_ros
+{
+
+/**
+ * Wall clock durations of the processing stages of one frame in seconds.
+ */
+struct StageTimes
+{
+  StageTimes() :
+    image_conversion(0.0),
+    depth_preparation(0.0),
+    feature_detection(0.0),
+    depth(0.0),
+    matching(0.0),
+    depth_refinement(0.0),
+    motion_estimation(0.0),
+    visualization(0.0)
+  {
+  }
+
+  double image_conversion;
+  double depth_preparation;
+  double feature_detection;
+  double depth;
+  double matching;
+  double depth_refinement;
+  double motion_estimation;
+  double visualization;
+};
+
+/**
+ * Adds the wall clock time spent in its scope to a duration.
+ * Compiles to nothing if FOVIS_ROS_DISABLE_STAGE_TIMING is defined.
+ */
+class ScopedStageTimer
+{
+
+public:
+
+#ifndef FOVIS_ROS_DISABLE_STAGE_TIMING
+  ScopedStageTimer(double& duration) :
+    duration_(duration),
+    start_time_(ros::WallTime::now())
+  {
+  }
+
+  ~ScopedStageTimer()
+  {
+    duration_ += (ros::WallTime::now() - start_time_).toSec();
+  }
+
+private:
+
+  double& duration_;
+  ros::WallTime start_time_;
+#else
+  ScopedStageTimer(double&) {}
+#endif
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef STEREO_ODOMETER_H_
+#define STEREO_ODOMETER_H_
+
+#include <ros/ros.h>
+#include <sensor_msgs/image_encodings.h>
+#include <image_geometry/stereo_camera_model.h>
+#include <cv_bridge/cv_bridge.h>
+
+#include <fovis_ros/FovisInfo.h>
+
+#include <fovis/stereo_depth.hpp>
+
+#include "stereo_processor.hpp"
+#include "odometer_base.hpp"
+#include "row_band_stereo_depth.hpp"
+#include "visualization.hpp"
+
+namespace fovis_ros
+{
+
+class StereoOdometer : public StereoProcessor, protected OdometerBase
+{
+
+private:
+
+  bool row_band_stereo_;
+  fovis::StereoDepth* stereo_depth_;
+  RowBandStereoDepth* row_band_stereo_depth_;
+  std::vector<uint8_t> r_image_buffer_;
+
+  // right image of the current frame
+  DepthPreparation set_right_image_;
+  sensor_msgs::ImageConstPtr r_image_msg_;
+  cv_bridge::CvImageConstPtr r_cv_ptr_;
+
+public:
+
+  // OdometerBase holds fixed size Eigen members
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  StereoOdometer(const ros::NodeHandle& nh, const ros::NodeHandle& local_nh,
+      const std::string& transport,
+      const SharedResources& shared = SharedResources()) :
+    StereoProcessor(nh, local_nh, transport, shared.thread_pool),
+    OdometerBase(local_nh, shared),
+    stereo_depth_(NULL),
+    row_band_stereo_depth_(NULL)
+  {
+    local_nh.param("row_band_stereo", row_band_stereo_, false);
+    set_right_image_ = boost::bind(&StereoOdometer::setRightImage, this);
+    warmStartFromCache(2);
+  }
+
+  ~StereoOdometer()
+  {
+    unsubscribe();
+    stopPipeline();
+    stopPublisher();
+    if (stereo_depth_) delete stereo_depth_;
+    if (row_band_stereo_depth_) delete row_band_stereo_depth_;
+  }
+
+  /**
+   * Starts publishing and subscribes to the input topics. Call this once
+   * the odometer is constructed, nothing is processed before.
+   */
+  void start()
+  {
+    startPublisher();
+    subscribe();
+  }
+
+protected:
+
+  fovis::StereoDepth* createStereoDepth(
+      const sensor_msgs::CameraInfoConstPtr& l_info_msg,
+      const sensor_msgs::CameraInfoConstPtr& r_info_msg)
+  {
+    // read calibration info from camera info message
+    // to fill remaining parameters
+    image_geometry::StereoCameraModel model;
+    model.fromCameraInfo(*l_info_msg, *r_info_msg);
+    
+    // initialize left and right camera parameters, the image size is the
+    // reduced resolution (binning and camera info roi) like in initOdometer()
+    fovis::CameraIntrinsicsParameters left_parameters;
+    rosToFovis(model.left(), left_parameters);
+    fovis::CameraIntrinsicsParameters right_parameters;
+    rosToFovis(model.right(), right_parameters);
+    // both images are cut and scaled the same way, so
+    // rotation and baseline stay untouched
+    adjustToImageRegion(left_parameters);
+    adjustToImageRegion(right_parameters);
+
+    // as we use rectified images, rotation is identity
+    // and translation is baseline only
+    fovis::StereoCalibrationParameters stereo_parameters;
+    stereo_parameters.left_parameters = left_parameters;
+    stereo_parameters.right_parameters = right_parameters;
+    stereo_parameters.right_to_left_rotation[0] = 1.0;
+    stereo_parameters.right_to_left_rotation[1] = 0.0;
+    stereo_parameters.right_to_left_rotation[2] = 0.0;
+    stereo_parameters.right_to_left_rotation[3] = 0.0;
+    stereo_parameters.right_to_left_translation[0] = -model.baseline();
+    stereo_parameters.right_to_left_translation[1] = 0.0;
+    stereo_parameters.right_to_left_translation[2] = 0.0;
+
+    fovis::StereoCalibration* stereo_calibration = 
+      new fovis::StereoCalibration(stereo_parameters);
+
+    return new fovis::StereoDepth(stereo_calibration, getOptions());
+  }
+
+  RowBandStereoDepth* createRowBandStereoDepth(
+      const sensor_msgs::CameraInfoConstPtr& l_info_msg,
+      const sensor_msgs::CameraInfoConstPtr& r_info_msg)
+  {
+    image_geometry::StereoCameraModel model;
+    model.fromCameraInfo(*l_info_msg, *r_info_msg);
+
+    fovis::CameraIntrinsicsParameters left_parameters;
+    rosToFovis(model.left(), left_parameters);
+    fovis::CameraIntrinsicsParameters right_parameters;
+    rosToFovis(model.right(), right_parameters);
+    adjustToImageRegion(left_parameters);
+    adjustToImageRegion(right_parameters);
+
+    return new RowBandStereoDepth(left_parameters, model.baseline(),
+        left_parameters.cx - right_parameters.cx, getOptions());
+  }
+
+  fovis::DepthSource* createDepthSource(const CameraInfos& infos)
+  {
+    if (stereo_depth_) delete stereo_depth_;
+    if (row_band_stereo_depth_) delete row_band_stereo_depth_;
+    stereo_depth_ = NULL;
+    row_band_stereo_depth_ = NULL;
+    r_image_buffer_.reserve(infos[1]->width * infos[1]->height);
+    if (row_band_stereo_)
+    {
+      row_band_stereo_depth_ = createRowBandStereoDepth(infos[0], infos[1]);
+      return row_band_stereo_depth_;
+    }
+    stereo_depth_ = createStereoDepth(infos[0], infos[1]);
+    return stereo_depth_;
+  }
+
+  void infoCallback(const sensor_msgs::CameraInfoConstPtr& info_msg, size_t index)
+  {
+    warmStart(info_msg, index, 2);
+  }
+
+  void imageCallback(
+      const sensor_msgs::ImageConstPtr& l_image_msg,
+      const sensor_msgs::ImageConstPtr& r_image_msg,
+      const sensor_msgs::CameraInfoConstPtr& l_info_msg,
+      const sensor_msgs::CameraInfoConstPtr& r_info_msg)
+  {
+    initialize(l_info_msg, r_info_msg);
+
+    ROS_ASSERT(l_image_msg->width == r_image_msg->width);
+    ROS_ASSERT(l_image_msg->height == r_image_msg->height);
+
+    // call base implementation, the right image is kept alive
+    // until processing is done
+    r_image_msg_ = r_image_msg;
+    process(l_image_msg, getPipelineStatistics(), set_right_image_);
+    r_image_msg_.reset();
+    r_cv_ptr_.reset();
+  }
+
+  /**
+   * Converts the right image if necessary and passes it to the depth
+   * source, fovis::StereoDepth builds the right image pyramid from it.
+   */
+  bool setRightImage()
+  {
+    const uint8_t* r_image_data =
+      getMono8Data(r_image_msg_, r_cv_ptr_, r_image_buffer_);
+    if (row_band_stereo_depth_)
+      row_band_stereo_depth_->setRightImage(r_image_data);
+    else
+      stereo_depth_->setRightImage(r_image_data);
+    return true;
+  }
+};
+
+} // end of namespace
+
+#endif
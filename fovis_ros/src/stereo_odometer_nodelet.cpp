@@ -0,0 +1,35 @@
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+#include "stereo_odometer.hpp"
+
+namespace fovis_ros
+{
+
+/**
+ * Nodelet wrapper for StereoOdometer. Running the odometer in the same
+ * process as the camera driver and stereo_image_proc lets it receive the
+ * images by shared pointer instead of serializing them.
+ */
+class StereoOdometerNodelet : public nodelet::Nodelet
+{
+
+private:
+
+  boost::shared_ptr<StereoOdometer> odometer_;
+
+  virtual void onInit()
+  {
+    ros::NodeHandle& nh = getNodeHandle();
+    ros::NodeHandle& local_nh = getPrivateNodeHandle();
+    std::string transport;
+    local_nh.param("transport", transport, std::string("raw"));
+    odometer_.reset(new StereoOdometer(nh, local_nh, transport));
+    odometer_->start();
+  }
+};
+
+} // end of namespace
+
+PLUGINLIB_DECLARE_CLASS(fovis_ros, stereo_odometer, fovis_ros::StereoOdometerNodelet, nodelet::Nodelet);
+
@@ -11,6 +11,10 @@
 #include <message_filters/sync_policies/approximate_time.h>
 #include <image_transport/subscriber_filter.h>
 
+#include <boost/scoped_ptr.hpp>
+
+#include "frame_pipeline.hpp"
+
 namespace fovis_ros
 {
 
@@ -26,6 +30,8 @@ class StereoProcessor
 private:
 
   // subscriber
+  ros::NodeHandle nh_;
+  std::string transport_;
   image_transport::SubscriberFilter left_sub_, right_sub_;
   message_filters::Subscriber<sensor_msgs::CameraInfo> left_info_sub_, right_info_sub_;
   typedef message_filters::sync_policies::ExactTime<sensor_msgs::Image, sensor_msgs::Image, sensor_msgs::CameraInfo, sensor_msgs::CameraInfo> ExactPolicy;
@@ -36,6 +42,9 @@ private:
   boost::shared_ptr<ApproximateSync> approximate_sync_;
   int queue_size_;
 
+  // optional hand-over of tuples to a worker thread
+  boost::scoped_ptr<FramePipeline<> > pipeline_;
+
   // for sync checking
   ros::WallTimer check_synced_timer_;
   int left_received_, right_received_, left_info_received_, right_info_received_, all_received_;
@@ -55,8 +64,11 @@ private:
     // For sync error checking
     ++all_received_; 
 
-    // call implementation
-    imageCallback(l_image_msg, r_image_msg, l_info_msg, r_info_msg);
+    // call implementation directly or through the worker thread
+    if (pipeline_)
+      pipeline_->push(l_image_msg, r_image_msg, l_info_msg, r_info_msg);
+    else
+      imageCallback(l_image_msg, r_image_msg, l_info_msg, r_info_msg);
   }
 
   void checkInputsSynchronized()
@@ -89,43 +101,42 @@ private:
 protected:
 
   /**
-   * Constructor, subscribes to input topics using image transport and registers
-   * callbacks.
+   * Constructor, registers callbacks. Does not subscribe yet, see subscribe().
+   * \param nh The node handle used to resolve and subscribe to topics
+   * \param local_nh The private node handle used to read parameters
    * \param transport The image transport to use
+   * \param thread_pool Shared pool that processes the tuples, if given
    */
-  StereoProcessor(const std::string& transport) :
+  StereoProcessor(const ros::NodeHandle& nh, const ros::NodeHandle& local_nh,
+      const std::string& transport,
+      const boost::shared_ptr<ThreadPool>& thread_pool = boost::shared_ptr<ThreadPool>()) :
+    nh_(nh), transport_(transport),
     left_received_(0), right_received_(0), left_info_received_(0), right_info_received_(0), all_received_(0)
   {
-    // Read local parameters
-    ros::NodeHandle local_nh("~");
-
-    // Resolve topic names
-    ros::NodeHandle nh;
-    std::string stereo_ns = nh.resolveName("stereo");
-    std::string left_topic = ros::names::clean(stereo_ns + "/left/" + nh.resolveName("image"));
-    std::string right_topic = ros::names::clean(stereo_ns + "/right/" + nh.resolveName("image"));
-
-    std::string left_info_topic = stereo_ns + "/left/camera_info";
-    std::string right_info_topic = stereo_ns + "/right/camera_info";
-
-    // Subscribe to four input topics.
-    ROS_INFO("Subscribing to:\n\t* %s\n\t* %s\n\t* %s\n\t* %s", 
-        left_topic.c_str(), right_topic.c_str(),
-        left_info_topic.c_str(), right_info_topic.c_str());
-
-    image_transport::ImageTransport it(nh);
-    left_sub_.subscribe(it, left_topic, 1, transport);
-    right_sub_.subscribe(it, right_topic, 1, transport);
-    left_info_sub_.subscribe(nh, left_info_topic, 1);
-    right_info_sub_.subscribe(nh, right_info_topic, 1);
-
-    // Complain every 15s if the topics appear unsynchronized
+    // Count received messages for sync checking
     left_sub_.registerCallback(boost::bind(StereoProcessor::increment, &left_received_));
     right_sub_.registerCallback(boost::bind(StereoProcessor::increment, &right_received_));
     left_info_sub_.registerCallback(boost::bind(StereoProcessor::increment, &left_info_received_));
     right_info_sub_.registerCallback(boost::bind(StereoProcessor::increment, &right_info_received_));
-    check_synced_timer_ = nh.createWallTimer(ros::WallDuration(15.0),
-                                             boost::bind(&StereoProcessor::checkInputsSynchronized, this));
+
+    // Camera infos arrive before the first synchronized tuple
+    left_info_sub_.registerCallback(boost::bind(&StereoProcessor::infoCallback, this, _1, 0));
+    right_info_sub_.registerCallback(boost::bind(&StereoProcessor::infoCallback, this, _1, 1));
+
+    // Optionally process tuples in a dedicated worker thread
+    // or on a pool shared with other odometers
+    bool pipelined;
+    local_nh.param("pipelined", pipelined, false);
+    if (thread_pool)
+    {
+      pipeline_.reset(new FramePipeline<>(
+            boost::bind(&StereoProcessor::imageCallback, this, _1, _2, _3, _4), thread_pool));
+    }
+    else if (pipelined)
+    {
+      pipeline_.reset(new FramePipeline<>(
+            boost::bind(&StereoProcessor::imageCallback, this, _1, _2, _3, _4)));
+    }
 
     // Synchronize input topics. Optionally do approximate synchronization.
     local_nh.param("queue_size", queue_size_, 5);
@@ -145,6 +156,78 @@ protected:
     }
   }
 
+  /**
+   * Subscribes to the input topics. Callbacks may run on other threads
+   * as soon as this returns, so sub-classes must not call this before
+   * they are fully constructed.
+   */
+  void subscribe()
+  {
+    // Resolve topic names
+    std::string stereo_ns = nh_.resolveName("stereo");
+    std::string left_topic = ros::names::clean(stereo_ns + "/left/" + nh_.resolveName("image"));
+    std::string right_topic = ros::names::clean(stereo_ns + "/right/" + nh_.resolveName("image"));
+
+    std::string left_info_topic = stereo_ns + "/left/camera_info";
+    std::string right_info_topic = stereo_ns + "/right/camera_info";
+
+    // Subscribe to four input topics.
+    ROS_INFO("Subscribing to:\n\t* %s\n\t* %s\n\t* %s\n\t* %s", 
+        left_topic.c_str(), right_topic.c_str(),
+        left_info_topic.c_str(), right_info_topic.c_str());
+
+    image_transport::ImageTransport it(nh_);
+    left_sub_.subscribe(it, left_topic, 1, transport_);
+    right_sub_.subscribe(it, right_topic, 1, transport_);
+    left_info_sub_.subscribe(nh_, left_info_topic, 1);
+    right_info_sub_.subscribe(nh_, right_info_topic, 1);
+
+    // Complain every 15s if the topics appear unsynchronized
+    check_synced_timer_ = nh_.createWallTimer(ros::WallDuration(15.0),
+                                              boost::bind(&StereoProcessor::checkInputsSynchronized, this));
+  }
+
+  /**
+   * Shuts down the subscribers, callbacks that are running are waited
+   * for. Sub-classes have to call this first in their destructor.
+   */
+  void unsubscribe()
+  {
+    check_synced_timer_.stop();
+    left_sub_.unsubscribe();
+    right_sub_.unsubscribe();
+    left_info_sub_.unsubscribe();
+    right_info_sub_.unsubscribe();
+  }
+
+  /**
+   * Stops the worker thread in pipelined mode. Sub-classes have to call
+   * this in their destructor before releasing resources that are used
+   * by imageCallback().
+   */
+  void stopPipeline()
+  {
+    if (pipeline_) pipeline_->stop();
+  }
+
+  /**
+   * Returns hand-over statistics for the tuple that is currently processed.
+   */
+  PipelineStatistics getPipelineStatistics() const
+  {
+    return pipeline_ ? pipeline_->getStatistics() : PipelineStatistics();
+  }
+
+  /**
+   * Called with every camera info message of input index (0 for left,
+   * 1 for right), before synchronization. Override this to prepare for
+   * the first tuple.
+   */
+  virtual void infoCallback(const sensor_msgs::CameraInfoConstPtr& /*info_msg*/,
+                            size_t /*index*/)
+  {
+  }
+
   /**
    * Implement this method in sub-classes 
    */
@@ -0,0 +1,298 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace fovis_ros
+{
+
+/**
+ * Fixed set of worker threads that execute batches of independent tasks
+ * and single posted tasks. The threads are created once and reused for
+ * every frame, running a batch does not allocate memory once the job lists
+ * have grown to their largest size. One pool can be shared by several
+ * odometers.
+ * Workers take the queued jobs of running batches first, newest first, as
+ * the frames they belong to are being processed already. Posted tasks are
+ * taken in the order they were posted, so the tasks of one odometer cannot
+ * starve those of another.
+ * All threads share these two job lists behind one lock, there are no per
+ * thread queues to steal from. A frame only brings a handful of jobs, too
+ * few for the lock to be contended.
+ */
+class ThreadPool
+{
+
+public:
+
+  typedef boost::function<void ()> Task;
+  typedef boost::function<void (size_t)> IndexedTask;
+
+  /**
+   * Starts the worker threads.
+   * \param num_threads Number of worker threads, the thread calling run()
+   *                    participates as well
+   */
+  ThreadPool(size_t num_threads) :
+    shutdown_(false),
+    posted_head_(0),
+    num_posted_(0)
+  {
+    for (size_t i = 0; i < num_threads; ++i)
+    {
+      threads_.create_thread(boost::bind(&ThreadPool::work, this));
+    }
+  }
+
+  ~ThreadPool()
+  {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      shutdown_ = true;
+    }
+    condition_.notify_all();
+    threads_.join_all();
+  }
+
+  size_t getNumThreads() const
+  {
+    return threads_.size();
+  }
+
+  /**
+   * Executes all tasks and blocks until they are finished. The first task
+   * runs in the calling thread, which also helps with the queued tasks of
+   * the batch while waiting, so calling run() from within a task cannot
+   * dead lock.
+   * Exceptions thrown by tasks are rethrown in the calling thread as
+   * std::runtime_error.
+   */
+  void run(const std::vector<Task>& tasks)
+  {
+    run(tasks.size(), boost::bind(&ThreadPool::callTask, boost::cref(tasks), _1));
+  }
+
+  /**
+   * Same as above for task(0) ... task(num_tasks - 1).
+   */
+  void run(size_t num_tasks, const IndexedTask& task)
+  {
+    if (num_tasks == 0) return;
+
+    Batch batch;
+    batch.pending = num_tasks;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      for (size_t i = 1; i < num_tasks; ++i)
+      {
+        batch_jobs_.push_back(Job(&task, i, &batch));
+      }
+    }
+    condition_.notify_all();
+
+    execute(Job(&task, 0, &batch));
+
+    Job job;
+    while (!batch.isDone())
+    {
+      if (tryPop(&batch, job))
+      {
+        execute(job);
+      }
+      else
+      {
+        batch.wait();
+      }
+    }
+
+    if (!batch.error.empty())
+    {
+      throw std::runtime_error(batch.error);
+    }
+  }
+
+  /**
+   * Queues task(index) for one of the worker threads and returns
+   * immediately. The task is referenced, not copied, so it has to stay
+   * alive until it has been executed. Exceptions thrown by posted tasks
+   * are dropped, the task has to handle its errors itself.
+   */
+  void post(const IndexedTask& task, size_t index = 0)
+  {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      pushPosted(Job(&task, index, NULL));
+    }
+    condition_.notify_one();
+  }
+
+private:
+
+  struct Batch
+  {
+    Batch() : pending(0) {}
+
+    bool isDone()
+    {
+      boost::mutex::scoped_lock lock(mutex);
+      return pending == 0;
+    }
+
+    void wait()
+    {
+      boost::mutex::scoped_lock lock(mutex);
+      while (pending > 0)
+      {
+        condition.wait(lock);
+      }
+    }
+
+    void finish(const std::string& task_error)
+    {
+      // notify under the lock, the caller of run() destroys the batch
+      // as soon as it sees that nothing is pending anymore
+      boost::mutex::scoped_lock lock(mutex);
+      if (error.empty()) error = task_error;
+      --pending;
+      condition.notify_all();
+    }
+
+    size_t pending;
+    std::string error;
+    boost::mutex mutex;
+    boost::condition_variable condition;
+  };
+
+  struct Job
+  {
+    Job() : task(NULL), index(0), batch(NULL) {}
+    Job(const IndexedTask* task, size_t index, Batch* batch) :
+      task(task), index(index), batch(batch) {}
+
+    const IndexedTask* task;
+    size_t index;
+    Batch* batch;
+  };
+
+  static void callTask(const std::vector<Task>& tasks, size_t index)
+  {
+    tasks[index]();
+  }
+
+  static void execute(const Job& job)
+  {
+    std::string error;
+    try
+    {
+      (*job.task)(job.index);
+    }
+    catch (const std::exception& e)
+    {
+      error = e.what();
+    }
+    catch (...)
+    {
+      error = "unknown exception in thread pool task";
+    }
+    if (job.batch) job.batch->finish(error);
+  }
+
+  /**
+   * Takes a queued job of the given batch. Waiting callers only help with
+   * their own batch, so they neither get stuck in long posted tasks nor
+   * wait for jobs that are queued behind them.
+   */
+  bool tryPop(const Batch* batch, Job& job)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    for (size_t i = batch_jobs_.size(); i > 0; --i)
+    {
+      if (batch_jobs_[i - 1].batch == batch)
+      {
+        job = batch_jobs_[i - 1];
+        batch_jobs_.erase(batch_jobs_.begin() + (i - 1));
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Appends a job to the ring buffer of posted jobs, which only
+   * allocates when it is full.
+   */
+  void pushPosted(const Job& job)
+  {
+    if (num_posted_ == posted_jobs_.size())
+    {
+      std::vector<Job> jobs(std::max<size_t>(2 * posted_jobs_.size(), 8));
+      for (size_t i = 0; i < num_posted_; ++i)
+      {
+        jobs[i] = posted_jobs_[(posted_head_ + i) % posted_jobs_.size()];
+      }
+      posted_jobs_.swap(jobs);
+      posted_head_ = 0;
+    }
+    posted_jobs_[(posted_head_ + num_posted_) % posted_jobs_.size()] = job;
+    ++num_posted_;
+  }
+
+  Job popPosted()
+  {
+    Job job = posted_jobs_[posted_head_];
+    posted_head_ = (posted_head_ + 1) % posted_jobs_.size();
+    --num_posted_;
+    return job;
+  }
+
+  void work()
+  {
+    while (true)
+    {
+      Job job;
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        while (batch_jobs_.empty() && num_posted_ == 0 && !shutdown_)
+        {
+          condition_.wait(lock);
+        }
+        if (shutdown_) return;
+        if (!batch_jobs_.empty())
+        {
+          job = batch_jobs_.back();
+          batch_jobs_.pop_back();
+        }
+        else
+        {
+          job = popPosted();
+        }
+      }
+      execute(job);
+    }
+  }
+
+  bool shutdown_;
+  // jobs of running batches, taken from the back
+  std::vector<Job> batch_jobs_;
+  // posted jobs, a ring buffer in posting order
+  std::vector<Job> posted_jobs_;
+  size_t posted_head_;
+  size_t num_posted_;
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+  boost::thread_group threads_;
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef TIMED_DEPTH_SOURCE_H_
+#define TIMED_DEPTH_SOURCE_H_
+
+#include <ros/ros.h>
+
+#include <fovis/depth_source.hpp>
+
+#include "stage_timer.hpp"
+
+namespace fovis_ros
+{
+
+/**
+ * Depth source that forwards all calls to another depth source and
+ * records when fovis calls it. As fovis asks for depth after feature
+ * detection and for depth refinement after matching, this splits the
+ * time spent in VisualOdometry::processFrame() into stages without
+ * touching the library.
+ */
+class TimedDepthSource : public fovis::DepthSource
+{
+
+public:
+
+  TimedDepthSource() :
+    depth_source_(NULL)
+  {
+  }
+
+  /**
+   * To be called right before VisualOdometry::processFrame().
+   */
+  void start(fovis::DepthSource* depth_source)
+  {
+    depth_source_ = depth_source;
+    get_xyz_called_ = false;
+    refine_xyz_called_ = false;
+    get_xyz_time_ = 0.0;
+    refine_xyz_time_ = 0.0;
+    start_time_ = ros::WallTime::now();
+  }
+
+  /**
+   * To be called right after VisualOdometry::processFrame(), fills the
+   * fovis internal stages of times.
+   */
+  void stop(StageTimes& times) const
+  {
+    ros::WallTime end_time = ros::WallTime::now();
+    if (!get_xyz_called_)
+    {
+      times.feature_detection = (end_time - start_time_).toSec();
+      return;
+    }
+    times.feature_detection = (get_xyz_start_ - start_time_).toSec();
+    times.depth = get_xyz_time_;
+    if (!refine_xyz_called_)
+    {
+      times.matching = (end_time - get_xyz_end_).toSec();
+      return;
+    }
+    times.matching = (refine_xyz_start_ - get_xyz_end_).toSec();
+    times.depth_refinement = refine_xyz_time_;
+    times.motion_estimation = (end_time - refine_xyz_end_).toSec();
+  }
+
+  virtual bool haveXyz(int u, int v)
+  {
+    return depth_source_->haveXyz(u, v);
+  }
+
+  virtual void getXyz(fovis::OdometryFrame* frame)
+  {
+    ros::WallTime call_start = ros::WallTime::now();
+    depth_source_->getXyz(frame);
+    get_xyz_end_ = ros::WallTime::now();
+    if (!get_xyz_called_) get_xyz_start_ = call_start;
+    get_xyz_called_ = true;
+    get_xyz_time_ += (get_xyz_end_ - call_start).toSec();
+  }
+
+  virtual void refineXyz(fovis::FeatureMatch* matches, int num_matches,
+      fovis::OdometryFrame* frame)
+  {
+    ros::WallTime call_start = ros::WallTime::now();
+    depth_source_->refineXyz(matches, num_matches, frame);
+    refine_xyz_end_ = ros::WallTime::now();
+    if (!refine_xyz_called_) refine_xyz_start_ = call_start;
+    refine_xyz_called_ = true;
+    refine_xyz_time_ += (refine_xyz_end_ - call_start).toSec();
+  }
+
+  virtual double getBaseline() const
+  {
+    return depth_source_->getBaseline();
+  }
+
+private:
+
+  fovis::DepthSource* depth_source_;
+
+  ros::WallTime start_time_;
+  bool get_xyz_called_;
+  ros::WallTime get_xyz_start_, get_xyz_end_;
+  double get_xyz_time_;
+  bool refine_xyz_called_;
+  ros::WallTime refine_xyz_start_, refine_xyz_end_;
+  double refine_xyz_time_;
+};
+
+} // end of namespace
+
+#endif
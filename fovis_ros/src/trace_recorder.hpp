@@ -0,0 +1,222 @@
+#ifndef TRACE_RECORDER_H_
+#define TRACE_RECORDER_H_
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fovis_ros
+{
+
+/**
+ * Fixed size binary record of one processed frame. Only fixed size types
+ * are used and the fields are ordered so that the layout has no padding,
+ * the reader relies on the same layout.
+ */
+struct TraceRecord
+{
+  static const int MAX_LEVELS = 8;
+
+  enum Flags
+  {
+    MOTION_ESTIMATE_VALID = 1,
+    CHANGE_REFERENCE_FRAME = 2,
+    MOTION_PRIOR_USED = 4
+  };
+
+  /// header stamp of the frame in seconds
+  double stamp;
+  /// published pose of the base in the odom frame, orientation as x y z w
+  double position[3];
+  double orientation[4];
+  /// published twist of the base
+  double linear_velocity[3];
+  double angular_velocity[3];
+  /// row major, as published
+  double pose_covariance[36];
+  double twist_covariance[36];
+  /// the timings of FovisInfo in seconds
+  double runtime;
+  double queue_wait_time;
+  double image_conversion_time;
+  double depth_preparation_time;
+  double feature_detection_time;
+  double depth_time;
+  double matching_time;
+  double depth_refinement_time;
+  double motion_estimation_time;
+  double visualization_time;
+  double tf_lookup_time;
+  int32_t motion_estimate_status_code;
+  int32_t flags;
+  int32_t fast_threshold;
+  int32_t num_matches;
+  int32_t num_inliers;
+  int32_t num_reprojection_failures;
+  int32_t num_total_detected_keypoints;
+  int32_t num_total_keypoints;
+  int32_t num_skipped_frames;
+  int32_t num_dropped_tuples;
+  /// number of valid entries in the per level arrays
+  int32_t num_levels;
+  int32_t reserved;
+  int32_t num_detected_keypoints[MAX_LEVELS];
+  int32_t num_keypoints[MAX_LEVELS];
+};
+
+/**
+ * Start of a trace file, followed by capacity records.
+ */
+struct TraceHeader
+{
+  static const uint32_t VERSION = 1;
+
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t capacity;
+  /// total number of records written, the last min(num_written, capacity)
+  /// records are valid, the oldest one at num_written % capacity
+  volatile uint64_t num_written;
+};
+
+static const char TRACE_MAGIC[8] = { 'F', 'O', 'V', 'I', 'S', 'T', 'R', 'C' };
+
+/**
+ * Writes TraceRecords into a ring buffer in a memory mapped file. The
+ * file is created with its final size and touched on open, so recording
+ * a frame is a copy into memory, it never takes a lock and never waits for
+ * the disk. The kernel writes the pages back in the background, a trace
+ * survives a crash of the node. Only one thread may write.
+ */
+class TraceRecorder
+{
+
+public:
+
+  TraceRecorder() :
+    header_(NULL),
+    records_(NULL),
+    size_(0)
+  {
+  }
+
+  ~TraceRecorder()
+  {
+    close();
+  }
+
+  /**
+   * Creates the file and maps it. An existing file, e.g. the trace of a
+   * node that crashed and was respawned, is renamed to <filename>.1
+   * first, replacing an older one.
+   * \param capacity Number of records kept, older ones are overwritten
+   * \return false on failure, see getError()
+   */
+  bool open(const std::string& filename, size_t capacity)
+  {
+    close();
+    if (capacity == 0)
+    {
+      error_ = "capacity must be greater than 0";
+      return false;
+    }
+    std::string previous_filename = filename + ".1";
+    if (std::rename(filename.c_str(), previous_filename.c_str()) != 0 &&
+        errno != ENOENT)
+    {
+      error_ = "cannot keep the existing trace as '" + previous_filename +
+        "': " + std::strerror(errno);
+      return false;
+    }
+    int fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+    {
+      error_ = std::strerror(errno);
+      return false;
+    }
+    size_t size = sizeof(TraceHeader) + capacity * sizeof(TraceRecord);
+    void* data = MAP_FAILED;
+    if (::ftruncate(fd, size) == 0)
+    {
+      data = ::mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (data == MAP_FAILED)
+    {
+      error_ = std::strerror(errno);
+      ::close(fd);
+      return false;
+    }
+    // the mapping stays valid without the descriptor
+    ::close(fd);
+
+    // touch all pages now instead of faulting them in while recording
+    std::memset(data, 0, size);
+    header_ = static_cast<TraceHeader*>(data);
+    records_ = reinterpret_cast<TraceRecord*>(header_ + 1);
+    size_ = size;
+    std::memcpy(header_->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header_->version = TraceHeader::VERSION;
+    header_->record_size = sizeof(TraceRecord);
+    header_->capacity = capacity;
+    header_->num_written = 0;
+    return true;
+  }
+
+  void close()
+  {
+    if (header_)
+    {
+      ::munmap(header_, size_);
+      header_ = NULL;
+      records_ = NULL;
+      size_ = 0;
+    }
+  }
+
+  bool isOpen() const
+  {
+    return header_ != NULL;
+  }
+
+  const std::string& getError() const
+  {
+    return error_;
+  }
+
+  /**
+   * The record to fill next, call commit() when done.
+   */
+  TraceRecord& next()
+  {
+    return records_[header_->num_written % header_->capacity];
+  }
+
+  /**
+   * Makes the record returned by next() visible to readers.
+   */
+  void commit()
+  {
+    // the record has to be complete before the counter moves on
+    __sync_synchronize();
+    header_->num_written = header_->num_written + 1;
+  }
+
+private:
+
+  TraceHeader* header_;
+  TraceRecord* records_;
+  size_t size_;
+  std::string error_;
+};
+
+} // end of namespace
+
+#endif
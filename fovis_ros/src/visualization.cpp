@@ -1,66 +1,41 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <fovis/visual_odometry.hpp>
+#include <algorithm>
 #include <iostream>
+#include <sstream>
 
 #include "visualization.hpp"
 
 
-void _drawPyramidLevelMatches(const fovis::VisualOdometry* odometry, int level, 
+void _drawMatch(const fovis_ros::visualization::FeatureSnapshot::Match& match,
     cv::Mat& canvas)
 {
-  using namespace fovis;
-
-  cv::Mat target_canvas(canvas.rowRange(0, canvas.rows/2));
-  cv::Mat reference_canvas(canvas.rowRange(canvas.rows/2, canvas.rows));
- 
-  const PyramidLevel* reference_level = odometry->getReferenceFrame()->getLevel(0);
-  for (int i = 0; i < reference_level->getNumKeypoints(); ++i)
-  {
-    const KeyPoint& kp = reference_level->getKeypoint(i);
-    cv::Point2f center(kp.u, kp.v);
-    cv::circle(reference_canvas, center, (level+1)*10, cv::Scalar(255, 0, 0));
-  }
-  const PyramidLevel* target_level = odometry->getTargetFrame()->getLevel(0);
-  for (int i = 0; i < target_level->getNumKeypoints(); ++i)
-  {
-    const KeyPoint& kp = target_level->getKeypoint(i);
-    cv::Point2f center(kp.u, kp.v);
-    cv::circle(target_canvas, center, (level+1)*10, cv::Scalar(255, 0, 0));
-  }
-}
-
-void _drawMatch(const fovis::FeatureMatch& match, cv::Mat& canvas)
-{
-  using namespace fovis;
   cv::Mat target_canvas(canvas.rowRange(0, canvas.rows/2));
   cv::Mat reference_canvas(canvas.rowRange(canvas.rows/2, canvas.rows));
-  const KeyPoint& target_keypoint = match.target_keypoint->kp;
-  const KeyPoint& ref_keypoint = match.ref_keypoint->kp;
-  int target_level = match.target_keypoint->pyramid_level;
-  int ref_level = match.ref_keypoint->pyramid_level;
+  int target_level = match.target_pyramid_level;
+  int ref_level = match.ref_pyramid_level;
   cv::Point2f ref_center(
-      ref_keypoint.u*(ref_level+1), ref_keypoint.v*(ref_level+1));
+      match.ref_u*(ref_level+1), match.ref_v*(ref_level+1));
   cv::Point2f target_center(
-      target_keypoint.u*(target_level+1), target_keypoint.v*(target_level+1));
+      match.target_u*(target_level+1), match.target_v*(target_level+1));
   cv::Scalar color(0, 255, 0);
   if (!match.inlier)
     color = cv::Scalar(0, 0, 255);
-  cv::circle(reference_canvas, ref_center, 
-      (match.ref_keypoint->pyramid_level+1)*10, color);
-  cv::circle(target_canvas, target_center, 
-      (match.target_keypoint->pyramid_level+1)*10, color);
+  cv::circle(reference_canvas, ref_center, (ref_level+1)*10, color);
+  cv::circle(target_canvas, target_center, (target_level+1)*10, color);
   cv::Point2f global_ref_center(ref_center.x, ref_center.y + canvas.rows/2);
   cv::line(canvas, target_center, global_ref_center, color);
   // motion flow
   // cv::line(canvas, target_center, ref_center, color);
 }
 
-void _drawKeypoint(const fovis::KeypointData& kp_data, cv::Mat& canvas)
+void _drawKeypoint(const fovis_ros::visualization::FeatureSnapshot::Keypoint& kp,
+    cv::Mat& canvas)
 {
-  cv::Point2f center(kp_data.rect_base_uv.x(), kp_data.rect_base_uv.y());
+  cv::Point2f center(kp.u, kp.v);
   cv::Scalar color;
-  if (kp_data.has_depth)
+  if (kp.has_depth)
   {
     color = cv::Scalar(255, 0, 0);
   }
@@ -68,7 +43,7 @@ void _drawKeypoint(const fovis::KeypointData& kp_data, cv::Mat& canvas)
   {
     color = cv::Scalar(0, 0, 0);
   }
-  cv::circle(canvas, center, (kp_data.pyramid_level+1)*10, color);
+  cv::circle(canvas, center, (kp.pyramid_level+1)*10, color);
 }
 
 template<typename T>
@@ -79,65 +54,114 @@ std::string toStr(T t)
   return ss.str();
 }
 
-std::vector<std::string> _createInfoStrings(const fovis::VisualOdometry* odometry)
+std::vector<std::string> _createInfoStrings(
+    const fovis_ros::visualization::FeatureSnapshot& snapshot)
 {
   std::vector<std::string> infostrings;
-  infostrings.push_back(std::string("Status: ") + fovis::MotionEstimateStatusCodeStrings[odometry->getMotionEstimateStatus()]);
-  infostrings.push_back(toStr(odometry->getTargetFrame()->getNumDetectedKeypoints()) + " keypoints");
-  infostrings.push_back(toStr(odometry->getTargetFrame()->getNumKeypoints()) + " filtered keypoints");
-  infostrings.push_back(toStr(odometry->getMotionEstimator()->getNumMatches()) + " matches");
-  infostrings.push_back(toStr(odometry->getMotionEstimator()->getNumInliers()) + " inliers");
+  infostrings.push_back(std::string("Status: ") + fovis::MotionEstimateStatusCodeStrings[snapshot.motion_estimate_status]);
+  infostrings.push_back(toStr(snapshot.num_detected_keypoints) + " keypoints");
+  infostrings.push_back(toStr(snapshot.num_keypoints) + " filtered keypoints");
+  infostrings.push_back(toStr(snapshot.num_matches) + " matches");
+  infostrings.push_back(toStr(snapshot.num_inliers) + " inliers");
   return infostrings;
 }
 
-cv::Mat fovis_ros::visualization::paint(const fovis::VisualOdometry* odometry)
+void fovis_ros::visualization::takeSnapshot(
+    const fovis::VisualOdometry* odometry, FeatureSnapshot& snapshot)
 {
   using namespace fovis;
   const OdometryFrame* reference_frame = odometry->getReferenceFrame();
   const OdometryFrame* target_frame = odometry->getTargetFrame();
 
-  int width = target_frame->getLevel(0)->getWidth();
-  int height = target_frame->getLevel(0)->getHeight();
-
-  // We have to const cast here because there is no 
-  // cv::Mat constructor for const data.
-  // The data will be copied later anyways.
-  const cv::Mat reference_image(height, width, CV_8U, 
-      const_cast<unsigned char*>(
-        reference_frame->getLevel(0)->getGrayscaleImage()));
-  const cv::Mat target_image(height, width, CV_8U,
-      const_cast<unsigned char*>(
-        target_frame->getLevel(0)->getGrayscaleImage()),
-      target_frame->getLevel(0)->getGrayscaleImageStride());
-
-  cv::Mat canvas(2*height, width, CV_8U);
-  cv::Mat upper_canvas(canvas.rowRange(0, height));
-  cv::Mat lower_canvas(canvas.rowRange(height, 2*height));
-  target_image.copyTo(upper_canvas);
-  reference_image.copyTo(lower_canvas);
-  cv::cvtColor(canvas, canvas, CV_GRAY2BGR);
+  snapshot.width = target_frame->getLevel(0)->getWidth();
+  snapshot.height = target_frame->getLevel(0)->getHeight();
 
+  snapshot.reference_keypoints.clear();
   for (int level = 0; level < reference_frame->getNumLevels(); ++level)
   {
     const PyramidLevel* pyramid_level = reference_frame->getLevel(level);
     for (int i = 0; i < pyramid_level->getNumKeypoints(); ++i)
     {
-      _drawKeypoint(*(pyramid_level->getKeypointData(i)), canvas);
+      const KeypointData* kp_data = pyramid_level->getKeypointData(i);
+      FeatureSnapshot::Keypoint kp;
+      kp.u = kp_data->rect_base_uv.x();
+      kp.v = kp_data->rect_base_uv.y();
+      kp.pyramid_level = kp_data->pyramid_level;
+      kp.has_depth = kp_data->has_depth;
+      snapshot.reference_keypoints.push_back(kp);
     }
   }
-      
+
   const MotionEstimator* motion_estimator = odometry->getMotionEstimator(); 
+  snapshot.matches.resize(motion_estimator->getNumMatches());
   for (int i = 0; i < motion_estimator->getNumMatches(); ++i)
   {
-    _drawMatch(motion_estimator->getMatches()[i], canvas);
+    const FeatureMatch& feature_match = motion_estimator->getMatches()[i];
+    FeatureSnapshot::Match& match = snapshot.matches[i];
+    match.target_u = feature_match.target_keypoint->kp.u;
+    match.target_v = feature_match.target_keypoint->kp.v;
+    match.target_pyramid_level = feature_match.target_keypoint->pyramid_level;
+    match.ref_u = feature_match.ref_keypoint->kp.u;
+    match.ref_v = feature_match.ref_keypoint->kp.v;
+    match.ref_pyramid_level = feature_match.ref_keypoint->pyramid_level;
+    match.inlier = feature_match.inlier;
   }
-  std::vector<std::string> infostrings = _createInfoStrings(odometry);
+
+  snapshot.motion_estimate_status = odometry->getMotionEstimateStatus();
+  snapshot.num_detected_keypoints = target_frame->getNumDetectedKeypoints();
+  snapshot.num_keypoints = target_frame->getNumKeypoints();
+  snapshot.num_matches = motion_estimator->getNumMatches();
+  snapshot.num_inliers = motion_estimator->getNumInliers();
+}
+
+void fovis_ros::visualization::paint(const FeatureSnapshot& snapshot,
+    const cv::Mat& target_image, const cv::Mat& reference_image,
+    cv::Mat& canvas)
+{
+  int width = snapshot.width;
+  int height = snapshot.height;
+
+  // create() is a no-op if the canvas has the right size already,
+  // the color conversion then writes into the existing buffer
+  canvas.create(2*height, width, CV_8UC3);
+  cv::Mat upper_canvas(canvas.rowRange(0, height));
+  cv::Mat lower_canvas(canvas.rowRange(height, 2*height));
+  cv::cvtColor(target_image, upper_canvas, CV_GRAY2BGR);
+  cv::cvtColor(reference_image, lower_canvas, CV_GRAY2BGR);
+
+  for (size_t i = 0; i < snapshot.reference_keypoints.size(); ++i)
+  {
+    _drawKeypoint(snapshot.reference_keypoints[i], canvas);
+  }
+      
+  for (size_t i = 0; i < snapshot.matches.size(); ++i)
+  {
+    _drawMatch(snapshot.matches[i], canvas);
+  }
+  std::vector<std::string> infostrings = _createInfoStrings(snapshot);
   for (size_t i = 0; i < infostrings.size(); ++i)
   {
     cv::putText(canvas, infostrings[i], cv::Point(10, 40*(i + 1)),
           CV_FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(0, 255, 255), 3);
   }
-  return canvas;
 }
 
-
+cv::Mat fovis_ros::visualization::paint(const fovis::VisualOdometry* odometry)
+{
+  FeatureSnapshot snapshot;
+  takeSnapshot(odometry, snapshot);
+  // We have to const cast here because there is no 
+  // cv::Mat constructor for const data.
+  // The data will be copied later anyways.
+  const fovis::PyramidLevel* target_level = odometry->getTargetFrame()->getLevel(0);
+  const fovis::PyramidLevel* reference_level = odometry->getReferenceFrame()->getLevel(0);
+  const cv::Mat target_image(snapshot.height, snapshot.width, CV_8U,
+      const_cast<uint8_t*>(target_level->getGrayscaleImage()),
+      target_level->getGrayscaleImageStride());
+  const cv::Mat reference_image(snapshot.height, snapshot.width, CV_8U,
+      const_cast<uint8_t*>(reference_level->getGrayscaleImage()),
+      reference_level->getGrayscaleImageStride());
+  cv::Mat canvas;
+  paint(snapshot, target_image, reference_image, canvas);
+  return canvas;
+}
@@ -1,6 +1,8 @@
 #ifndef __FOVIS_ROS_VISUALIZATION_H__
 #define __FOVIS_ROS_VISUALIZATION_H__
 
+#include <vector>
+
 namespace cv
 {
   class Mat;
@@ -16,6 +18,58 @@ namespace fovis_ros
 
 namespace visualization
 {
+  /**
+   * Copy of the features needed for painting a frame, so that painting
+   * does not need access to the live odometer. The images are not part
+   * of it, they are taken from the input messages.
+   */
+  struct FeatureSnapshot
+  {
+    struct Keypoint
+    {
+      float u, v;
+      int pyramid_level;
+      bool has_depth;
+    };
+
+    struct Match
+    {
+      float target_u, target_v;
+      int target_pyramid_level;
+      float ref_u, ref_v;
+      int ref_pyramid_level;
+      bool inlier;
+    };
+
+    // size of the level 0 images
+    int width;
+    int height;
+
+    std::vector<Keypoint> reference_keypoints;
+    std::vector<Match> matches;
+
+    int motion_estimate_status;
+    int num_detected_keypoints;
+    int num_keypoints;
+    int num_matches;
+    int num_inliers;
+  };
+
+  /**
+   * Copies the keypoints and matches of the current state of the
+   * odometer into snapshot.
+   */
+  void takeSnapshot(const fovis::VisualOdometry* odometry,
+      FeatureSnapshot& snapshot);
+
+  /**
+   * Paints the snapshot onto the level 0 images of the target and the
+   * reference frame, which must have the size of the snapshot. canvas is
+   * only reallocated if the image size changes.
+   */
+  void paint(const FeatureSnapshot& snapshot, const cv::Mat& target_image,
+      const cv::Mat& reference_image, cv::Mat& canvas);
+
   cv::Mat paint(const fovis::VisualOdometry* odometry);
 } // end of namespace visualization
 
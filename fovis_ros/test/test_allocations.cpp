@@ -0,0 +1,133 @@
+#include <cstdlib>
+#include <new>
+
+#include <gtest/gtest.h>
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "../src/bounded_queue.hpp"
+#include "../src/message_pool.hpp"
+#include "../src/thread_pool.hpp"
+
+// Counts every heap allocation of the process, including the ones of
+// the worker threads.
+static volatile long num_allocations = 0;
+
+void* operator new(size_t size) throw(std::bad_alloc)
+{
+  __sync_fetch_and_add(&num_allocations, 1);
+  void* data = std::malloc(size > 0 ? size : 1);
+  if (!data) throw std::bad_alloc();
+  return data;
+}
+
+void operator delete(void* data) throw()
+{
+  std::free(data);
+}
+
+static long getNumAllocations()
+{
+  return __sync_fetch_and_add(&num_allocations, 0);
+}
+
+using fovis_ros::BoundedQueue;
+using fovis_ros::MessagePool;
+using fovis_ros::ThreadPool;
+
+struct Message
+{
+  std::vector<int> values;
+};
+
+static const int NUM_FRAMES = 100;
+
+TEST(Allocations, MessagePoolReusesReleasedMessages)
+{
+  MessagePool<Message> pool(2);
+  // a subscriber that keeps the last message until the next one arrives
+  MessagePool<Message>::Ptr held;
+  for (int i = 0; i < 3; ++i)
+  {
+    MessagePool<Message>::Ptr msg = pool.acquire();
+    msg->values.resize(100);
+    held = msg;
+  }
+
+  long start = getNumAllocations();
+  for (int i = 0; i < NUM_FRAMES; ++i)
+  {
+    MessagePool<Message>::Ptr msg = pool.acquire();
+    EXPECT_NE(held.get(), msg.get());
+    msg->values.resize(100);
+    held = msg;
+  }
+  EXPECT_EQ(0, getNumAllocations() - start);
+}
+
+TEST(Allocations, BoundedQueuePushAndPop)
+{
+  BoundedQueue<boost::shared_ptr<Message> > queue(3);
+  boost::shared_ptr<Message> value(new Message);
+  boost::shared_ptr<Message> popped;
+
+  long start = getNumAllocations();
+  for (int i = 0; i < NUM_FRAMES; ++i)
+  {
+    // overflow drops the oldest element without allocating
+    queue.push(value);
+    queue.push(value);
+    queue.push(value);
+    queue.push(value);
+    EXPECT_TRUE(queue.pop(popped));
+    EXPECT_TRUE(queue.tryPop(popped));
+    EXPECT_TRUE(queue.tryPop(popped));
+    EXPECT_FALSE(queue.tryPop(popped));
+  }
+  EXPECT_EQ(0, getNumAllocations() - start);
+}
+
+static void addIndex(volatile long* sum, size_t index)
+{
+  __sync_fetch_and_add(sum, static_cast<long>(index));
+}
+
+TEST(Allocations, ThreadPoolBatches)
+{
+  ThreadPool pool(3);
+  volatile long sum = 0;
+  volatile long posted_sum = 0;
+  // bound once, like the preparation tasks of the odometers
+  ThreadPool::IndexedTask task = boost::bind(addIndex, &sum, _1);
+  ThreadPool::IndexedTask posted_task = boost::bind(addIndex, &posted_sum, _1);
+
+  // the first round starts the workers and grows the job lists
+  for (int round = 0; round < 2; ++round)
+  {
+    long start = getNumAllocations();
+    for (int i = 0; i < NUM_FRAMES; ++i)
+    {
+      // one outstanding posted task, like the drain task of a pipeline
+      long posted_expected = posted_sum + 1;
+      pool.post(posted_task, 1);
+      pool.run(8, task);
+      while (posted_sum < posted_expected)
+      {
+        boost::this_thread::yield();
+      }
+    }
+    if (round > 0)
+    {
+      EXPECT_EQ(0, getNumAllocations() - start);
+    }
+  }
+  EXPECT_EQ(2 * NUM_FRAMES * 28, sum);
+  EXPECT_EQ(2 * NUM_FRAMES, posted_sum);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}